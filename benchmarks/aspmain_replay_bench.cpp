@@ -0,0 +1,155 @@
+// Replays audio tasks recorded with RECOMP_RSP_CAPTURE through the recompiled aspMain microcode or the native
+// implementation of it. Reports the time spent per task and checks that each task leaves RDRAM exactly as recorded.
+// Usage: aspmain_replay_bench <capture file> [iterations] [recompiled|native]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "ultramodern/ultra64.h"
+#include "rsp_task_capture.h"
+#include "audio_hle.h"
+
+extern RspUcodeFunc aspMain;
+
+// The microcode takes the task's microcode address as an extra argument in some runtime versions.
+template <typename... Args>
+static RspExitReason run_ucode(RspExitReason (*func)(uint8_t*, Args...), uint8_t* rdram, uint32_t ucode_addr) {
+    if constexpr (sizeof...(Args) == 0) {
+        return func(rdram);
+    }
+    else {
+        return func(rdram, ucode_addr);
+    }
+}
+
+static void apply_ranges(uint8_t* rdram, const std::vector<zelda64::rsp_capture::Range>& ranges) {
+    for (const auto& range : ranges) {
+        memcpy(rdram + range.offset, range.bytes.data(), range.bytes.size());
+    }
+}
+
+static RspExitReason run_task(uint8_t* rdram, const zelda64::rsp_capture::Task& task, bool native) {
+    memcpy(dmem, task.dmem.data(), zelda64::rsp_capture::dmem_size);
+
+    // Unsupported tasks are reported as a mismatch instead of falling back, so the timings only cover the native code.
+    if (native) {
+        return zelda64::audio_hle::run_task(rdram, dmem) ? RspExitReason::Broke : RspExitReason::Invalid;
+    }
+
+    OSTask os_task;
+    memcpy(&os_task, task.dmem.data() + 0xFC0, sizeof(os_task));
+    return run_ucode(aspMain, rdram, os_task.t.ucode);
+}
+
+// Compares the replay's RDRAM against the state the recording ended the task with. Every byte the recording has as
+// task output has to be reproduced, and every other byte has to be left alone. Returns the first offset that differs,
+// or UINT32_MAX if the replay matches.
+static uint32_t verify_task(const uint8_t* after, const uint8_t* before, const zelda64::rsp_capture::Task& task, std::vector<uint8_t>& expected) {
+    memcpy(expected.data(), before, zelda64::rsp_capture::rdram_size);
+    apply_ranges(expected.data(), task.outputs);
+
+    constexpr uint32_t block_size = 64;
+    for (uint32_t block = 0; block < zelda64::rsp_capture::rdram_size; block += block_size) {
+        if (memcmp(after + block, expected.data() + block, block_size) == 0) {
+            continue;
+        }
+        for (uint32_t offset = block; offset < block + block_size; offset++) {
+            if (after[offset] != expected[offset]) {
+                return offset;
+            }
+        }
+    }
+    return UINT32_MAX;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [iterations] [recompiled|native]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t iterations = (argc > 2) ? std::strtoull(argv[2], nullptr, 0) : 20;
+
+    zelda64::audio_hle::Mode mode = zelda64::audio_hle::Mode::Recompiled;
+    if (argc > 3 && (!zelda64::audio_hle::mode_from_string(argv[3], mode) || mode == zelda64::audio_hle::Mode::Verify)) {
+        fprintf(stderr, "Unknown microcode \"%s\"\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+    bool native = mode == zelda64::audio_hle::Mode::Native;
+
+    zelda64::rsp_capture::Recording recording;
+    if (!zelda64::rsp_capture::load(argv[1], recording) || recording.tasks.empty()) {
+        fprintf(stderr, "Failed to load RSP capture from %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    recomp::rsp::constants_init();
+
+    // Recordings cover the whole 24-bit range that the microcode masks DMA addresses to.
+    std::vector<uint8_t> rdram(zelda64::rsp_capture::rdram_size);
+    std::vector<uint8_t> before(zelda64::rsp_capture::rdram_size);
+    std::vector<uint8_t> expected(zelda64::rsp_capture::rdram_size);
+
+    // Verification pass.
+    size_t mismatches = 0;
+    memcpy(rdram.data(), recording.initial_rdram.data(), zelda64::rsp_capture::rdram_size);
+    for (size_t i = 0; i < recording.tasks.size(); i++) {
+        const auto& task = recording.tasks[i];
+        apply_ranges(rdram.data(), task.inputs);
+        memcpy(before.data(), rdram.data(), zelda64::rsp_capture::rdram_size);
+
+        RspExitReason exit_reason = run_task(rdram.data(), task, native);
+        if (exit_reason != RspExitReason::Broke) {
+            if (mismatches < 10) {
+                fprintf(stderr, "Task %zu didn't run to completion\n", i);
+            }
+            mismatches++;
+        }
+        else if (uint32_t offset = verify_task(rdram.data(), before.data(), task, expected); offset != UINT32_MAX) {
+            if (mismatches < 10) {
+                // A byte the replay left unchanged is a recorded output it didn't reproduce, anything else is a wrong write.
+                fprintf(stderr, "Task %zu doesn't match the recording at 0x%06X (%s)\n", i, offset,
+                    rdram[offset] == before[offset] ? "recorded output not written" : "wrong value written");
+            }
+            mismatches++;
+        }
+
+        // Continue from the recorded state so that one mismatch doesn't cascade into every following task.
+        memcpy(rdram.data(), before.data(), zelda64::rsp_capture::rdram_size);
+        apply_ranges(rdram.data(), task.outputs);
+    }
+
+    // Timing passes. Only the microcode itself is timed, not restoring the recorded RDRAM state between tasks.
+    uint64_t total_ns = 0;
+    uint64_t fastest_pass_ns = UINT64_MAX;
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        uint64_t pass_ns = 0;
+        memcpy(rdram.data(), recording.initial_rdram.data(), zelda64::rsp_capture::rdram_size);
+        for (const auto& task : recording.tasks) {
+            apply_ranges(rdram.data(), task.inputs);
+
+            auto start = std::chrono::steady_clock::now();
+            run_task(rdram.data(), task, native);
+            auto end = std::chrono::steady_clock::now();
+            pass_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            apply_ranges(rdram.data(), task.outputs);
+        }
+        total_ns += pass_ns;
+        fastest_pass_ns = std::min(fastest_pass_ns, pass_ns);
+    }
+
+    size_t task_count = recording.tasks.size();
+    if (iterations != 0) {
+        double mean_ns = double(total_ns) / double(iterations * task_count);
+        double best_ns = double(fastest_pass_ns) / double(task_count);
+        printf("%s microcode, %zu tasks x %zu iterations\n", native ? "native" : "recompiled", task_count, iterations);
+        printf("mean %10.1f ns/task, best pass %10.1f ns/task, %10.1f tasks/s\n", mean_ns, best_ns, 1e9 / mean_ns);
+    }
+    printf("%zu/%zu tasks match the recording\n", task_count - mismatches, task_count);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,56 @@
+// Microbenchmark for the audio sample conversion kernels in src/main/audio_convert.cpp.
+// Usage: audio_convert_bench [samples per chunk] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "audio_convert.h"
+
+int main(int argc, char** argv) {
+    // Default to roughly one VI worth of stereo samples at 32kHz, which is about what the game queues at once.
+    size_t sample_count = (argc > 1) ? std::strtoull(argv[1], nullptr, 0) : 1066;
+    size_t iterations = (argc > 2) ? std::strtoull(argv[2], nullptr, 0) : 200000;
+    sample_count &= ~size_t{1};
+
+    std::vector<int16_t> input(sample_count);
+    std::mt19937 rng{ 0x64 };
+    std::uniform_int_distribution<int> dist{ INT16_MIN, INT16_MAX };
+    for (int16_t& sample : input) {
+        sample = int16_t(dist(rng));
+    }
+
+    constexpr float scale = 0.5f / 32768.0f;
+    auto kernels = zelda64::audio::get_supported_convert_kernels();
+
+    std::vector<float> reference(sample_count);
+    kernels[0].func(input.data(), reference.data(), sample_count, scale);
+
+    std::vector<float> output(sample_count);
+    int ret = EXIT_SUCCESS;
+
+    for (const auto& kernel : kernels) {
+        // Warm up and check the output against the scalar kernel.
+        kernel.func(input.data(), output.data(), sample_count, scale);
+        bool matches = std::memcmp(output.data(), reference.data(), sample_count * sizeof(float)) == 0;
+        if (!matches) {
+            ret = EXIT_FAILURE;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            kernel.func(input.data(), output.data(), sample_count, scale);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double total_ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        double ns_per_chunk = total_ns / iterations;
+        printf("%-8s %10.1f ns/chunk %8.3f ns/sample %s\n",
+            kernel.name, ns_per_chunk, ns_per_chunk / sample_count, matches ? "" : "(MISMATCH)");
+    }
+
+    return ret;
+}
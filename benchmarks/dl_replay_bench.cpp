@@ -0,0 +1,275 @@
+// Replays display lists recorded with RECOMP_DL_CAPTURE through RT64 or the null renderer as fast as possible and
+// reports the CPU time spent submitting each frame, without any of the game's own work.
+// Usage: dl_replay_bench <capture file> [rt64|null] [iterations] [first frame] [frame count] [csv file]
+// RT64 can be run on a software Vulkan device by pointing VK_ICD_FILENAMES at it, e.g. lavapipe's lvp_icd json.
+// The csv file gets the submit time of every frame of every iteration, for finding the frames a regression affects.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#define HLSL_CPU
+#include "hle/rt64_application.h"
+
+#define SDL_MAIN_HANDLED
+#ifdef _WIN32
+#include "SDL.h"
+#include "SDL_syswm.h"
+#else
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_syswm.h"
+// Undefine x11 macros that get included by SDL_syswm.h.
+#undef None
+#undef Status
+#undef LockMask
+#undef ControlMask
+#undef Success
+#undef Always
+#endif
+
+#include "zelda_render.h"
+#include "dl_capture.h"
+
+static uint8_t DMEM[0x1000];
+static uint8_t IMEM[0x1000];
+static ultramodern::renderer::ViRegs vi_regs;
+
+static unsigned int MI_INTR_REG = 0;
+static unsigned int DPC_START_REG = 0;
+static unsigned int DPC_END_REG = 0;
+static unsigned int DPC_CURRENT_REG = 0;
+static unsigned int DPC_STATUS_REG = 0;
+static unsigned int DPC_CLOCK_REG = 0;
+static unsigned int DPC_BUFBUSY_REG = 0;
+static unsigned int DPC_PIPEBUSY_REG = 0;
+static unsigned int DPC_TMEM_REG = 0;
+
+static void dummy_check_interrupts() {}
+
+// Sets up RT64 the same way RT64Context does, minus the UI hooks and texture packs, which the replay doesn't need.
+static std::unique_ptr<RT64::Application> create_rt64(uint8_t* rdram, SDL_Window* window) {
+    static unsigned char dummy_rom_header[0x40];
+
+    SDL_SysWMinfo wmInfo;
+    SDL_VERSION(&wmInfo.version);
+    SDL_GetWindowWMInfo(window, &wmInfo);
+
+    RT64::Application::Core appCore{};
+#if defined(_WIN32)
+    appCore.window = wmInfo.info.win.window;
+#elif defined(__linux__) || defined(__ANDROID__)
+    appCore.window = ultramodern::renderer::WindowHandle{ window };
+#elif defined(__APPLE__)
+    SDL_MetalView view = SDL_Metal_CreateView(window);
+    appCore.window.window = wmInfo.info.cocoa.window;
+    appCore.window.view = SDL_Metal_GetLayer(view);
+#endif
+
+    appCore.checkInterrupts = dummy_check_interrupts;
+
+    appCore.HEADER = dummy_rom_header;
+    appCore.RDRAM = rdram;
+    appCore.DMEM = DMEM;
+    appCore.IMEM = IMEM;
+
+    appCore.MI_INTR_REG = &MI_INTR_REG;
+
+    appCore.DPC_START_REG = &DPC_START_REG;
+    appCore.DPC_END_REG = &DPC_END_REG;
+    appCore.DPC_CURRENT_REG = &DPC_CURRENT_REG;
+    appCore.DPC_STATUS_REG = &DPC_STATUS_REG;
+    appCore.DPC_CLOCK_REG = &DPC_CLOCK_REG;
+    appCore.DPC_BUFBUSY_REG = &DPC_BUFBUSY_REG;
+    appCore.DPC_PIPEBUSY_REG = &DPC_PIPEBUSY_REG;
+    appCore.DPC_TMEM_REG = &DPC_TMEM_REG;
+
+    appCore.VI_STATUS_REG = &vi_regs.VI_STATUS_REG;
+    appCore.VI_ORIGIN_REG = &vi_regs.VI_ORIGIN_REG;
+    appCore.VI_WIDTH_REG = &vi_regs.VI_WIDTH_REG;
+    appCore.VI_INTR_REG = &vi_regs.VI_INTR_REG;
+    appCore.VI_V_CURRENT_LINE_REG = &vi_regs.VI_V_CURRENT_LINE_REG;
+    appCore.VI_TIMING_REG = &vi_regs.VI_TIMING_REG;
+    appCore.VI_V_SYNC_REG = &vi_regs.VI_V_SYNC_REG;
+    appCore.VI_H_SYNC_REG = &vi_regs.VI_H_SYNC_REG;
+    appCore.VI_LEAP_REG = &vi_regs.VI_LEAP_REG;
+    appCore.VI_H_START_REG = &vi_regs.VI_H_START_REG;
+    appCore.VI_V_START_REG = &vi_regs.VI_V_START_REG;
+    appCore.VI_V_BURST_REG = &vi_regs.VI_V_BURST_REG;
+    appCore.VI_X_SCALE_REG = &vi_regs.VI_X_SCALE_REG;
+    appCore.VI_Y_SCALE_REG = &vi_regs.VI_Y_SCALE_REG;
+
+    RT64::ApplicationConfiguration appConfig;
+    appConfig.useConfigurationFile = false;
+
+    auto app = std::make_unique<RT64::Application>(appCore, appConfig);
+    app->enhancementConfig.f3dex.forceBranch = true;
+    app->enhancementConfig.textureLOD.scale = true;
+    if (app->setup(0) != RT64::Application::SetupResult::Success) {
+        return nullptr;
+    }
+    return app;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [rt64|null] [iterations] [first frame] [frame count] [csv file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool use_null = false;
+    if (argc > 2) {
+        if (strcmp(argv[2], "null") == 0) {
+            use_null = true;
+        }
+        else if (strcmp(argv[2], "rt64") != 0) {
+            fprintf(stderr, "Unknown renderer \"%s\"\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+    size_t iterations = (argc > 3) ? std::strtoull(argv[3], nullptr, 0) : 5;
+    size_t first_frame = (argc > 4) ? std::strtoull(argv[4], nullptr, 0) : 0;
+    size_t frame_count = (argc > 5) ? std::strtoull(argv[5], nullptr, 0) : SIZE_MAX;
+    const char* csv_path = (argc > 6) ? argv[6] : nullptr;
+
+    zelda64::dl_capture::Reader reader;
+    if (!reader.open(argv[1]) || first_frame >= reader.frame_count()) {
+        fprintf(stderr, "Failed to load display list capture from %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    frame_count = std::min(frame_count, reader.frame_count() - first_frame);
+
+    // The renderer gets its own copy of RDRAM so that anything it writes back, e.g. framebuffers, can't leak into
+    // the following frames and make the replay depend on the renderer. Display lists can address the full 24 bits.
+    std::vector<uint8_t> recorded_rdram(zelda64::dl_capture::rdram_size);
+    std::vector<uint8_t> rdram(size_t{16} * 1024 * 1024);
+
+    SDL_Window* window = nullptr;
+    std::unique_ptr<RT64::Application> app;
+    std::unique_ptr<zelda64::renderer::NullContext> null_context;
+    if (use_null) {
+        null_context = std::make_unique<zelda64::renderer::NullContext>(rdram.data());
+    }
+    else {
+        uint32_t flags = 0;
+#if defined(__APPLE__)
+        flags |= SDL_WINDOW_METAL;
+#elif defined(RT64_SDL_WINDOW_VULKAN)
+        flags |= SDL_WINDOW_VULKAN;
+#endif
+        if (SDL_Init(SDL_INIT_VIDEO) != 0 ||
+            (window = SDL_CreateWindow("Display list replay", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 480, flags)) == nullptr)
+        {
+            fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
+            return EXIT_FAILURE;
+        }
+        app = create_rt64(rdram.data(), window);
+        if (app == nullptr) {
+            fprintf(stderr, "Failed to set up RT64\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE* csv_file = nullptr;
+    if (csv_path != nullptr) {
+        csv_file = fopen(csv_path, "w");
+        if (csv_file == nullptr) {
+            fprintf(stderr, "Failed to open %s\n", csv_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(csv_file, "iteration,frame,submit_ns\n");
+    }
+
+    // Only submitting the display list is timed, not loading the frame or presenting it. The first iteration also
+    // covers shader and texture cache misses, so it's reported separately.
+    std::vector<uint64_t> frame_ns;
+    frame_ns.reserve(iterations * frame_count);
+    uint64_t first_iteration_ns = 0;
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        uint64_t iteration_ns = 0;
+        for (size_t frame_index = first_frame; frame_index < first_frame + frame_count; frame_index++) {
+            bool loaded = (frame_index == first_frame) ?
+                reader.seek(frame_index, recorded_rdram.data()) :
+                reader.load_frame(frame_index, recorded_rdram.data());
+            if (!loaded) {
+                fprintf(stderr, "Failed to load frame %zu\n", frame_index);
+                return EXIT_FAILURE;
+            }
+
+            const zelda64::dl_capture::FrameInfo& frame = reader.get_frame(frame_index);
+            memcpy(rdram.data(), recorded_rdram.data(), recorded_rdram.size());
+            vi_regs = frame.vi_regs;
+
+            OSTask task{};
+            task.t.ucode = frame.ucode;
+            task.t.ucode_data = frame.ucode_data;
+            task.t.ucode_data_size = frame.ucode_data_size;
+            task.t.data_ptr = frame.data_ptr;
+
+            auto start = std::chrono::steady_clock::now();
+            if (use_null) {
+                null_context->send_dl(&task);
+            }
+            else {
+                app->state->rsp->reset();
+                app->interpreter->loadUCodeGBI(task.t.ucode & 0x3FFFFFF, task.t.ucode_data & 0x3FFFFFF, true);
+                app->processDisplayLists(app->core.RDRAM, task.t.data_ptr & 0x3FFFFFF, 0, true);
+            }
+            auto end = std::chrono::steady_clock::now();
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            if (!use_null) {
+                app->updateScreen();
+                SDL_PumpEvents();
+            }
+
+            iteration_ns += ns;
+            if (iteration != 0) {
+                frame_ns.push_back(ns);
+            }
+            if (csv_file != nullptr) {
+                fprintf(csv_file, "%zu,%zu,%llu\n", iteration, frame_index, (unsigned long long)ns);
+            }
+        }
+
+        if (iteration == 0) {
+            first_iteration_ns = iteration_ns;
+        }
+    }
+
+    if (csv_file != nullptr) {
+        fclose(csv_file);
+    }
+
+    printf("%s, frames %zu-%zu x %zu iterations\n", use_null ? "null renderer" : "RT64", first_frame, first_frame + frame_count - 1, iterations);
+    if (iterations != 0) {
+        printf("first iteration %10.1f us/frame\n", double(first_iteration_ns) / double(frame_count) / 1000.0);
+    }
+    if (!frame_ns.empty()) {
+        uint64_t total_ns = 0;
+        for (uint64_t ns : frame_ns) {
+            total_ns += ns;
+        }
+        std::sort(frame_ns.begin(), frame_ns.end());
+        auto percentile_us = [&frame_ns](double fraction) {
+            return double(frame_ns[std::min(frame_ns.size() - 1, size_t(double(frame_ns.size()) * fraction))]) / 1000.0;
+        };
+        printf("mean %10.1f us/frame, p50 %10.1f us, p95 %10.1f us, p99 %10.1f us, max %10.1f us\n",
+            double(total_ns) / double(frame_ns.size()) / 1000.0, percentile_us(0.5), percentile_us(0.95), percentile_us(0.99),
+            double(frame_ns.back()) / 1000.0);
+    }
+
+    if (use_null) {
+        null_context->shutdown();
+    }
+    else {
+        app->end();
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+
+    return EXIT_SUCCESS;
+}
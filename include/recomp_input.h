@@ -1,6 +1,7 @@
 #ifndef __RECOMP_INPUT_H__
 #define __RECOMP_INPUT_H__
 
+#include <array>
 #include <cstdint>
 #include <variant>
 #include <vector>
@@ -69,11 +70,27 @@ namespace recomp {
         auto operator<=>(const InputField& rhs) const = default;
     };
 
+    // Number of N64 controller ports. Each connected controller is routed to one of them, and the keyboard is always
+    // routed to keyboard_n64_port.
+    constexpr int num_n64_ports = 4;
+    constexpr int keyboard_n64_port = 0;
+
     void poll_inputs();
+    // Just-in-time sampling also takes an input snapshot every time the game reads the controllers instead of only
+    // when it polls them. A background thread refreshes controller state pump_rate_hz times a second so that those
+    // snapshots see recent values. Keyboard state can only be refreshed by the gfx thread's event pumping.
+    void start_just_in_time_input(int pump_rate_hz);
+    void stop_just_in_time_input();
+    // Called from the game thread when it starts reading the controllers.
+    void sample_inputs_for_read();
+    // These read the inputs of every port.
     float get_input_analog(const InputField& field);
     float get_input_analog(const std::span<const recomp::InputField> fields);
     bool get_input_digital(const InputField& field);
     bool get_input_digital(const std::span<const recomp::InputField> fields);
+    // These only read the inputs routed to the given port.
+    float get_input_analog(int port, const std::span<const recomp::InputField> fields);
+    bool get_input_digital(int port, const std::span<const recomp::InputField> fields);
     void get_gyro_deltas(float* x, float* y);
     void get_mouse_deltas(float* x, float* y);
     void get_right_analog(float* x, float* y);
@@ -160,9 +177,54 @@ namespace recomp {
     InputField& get_input_binding(GameInput input, size_t binding_index, InputDevice device);
     void set_input_binding(GameInput input, size_t binding_index, InputDevice device, InputField value);
 
+    // N64 stick directions, used as bit indices in CompiledBinding::axes.
+    enum class N64Axis {
+        XPos,
+        XNeg,
+        YPos,
+        YNeg,
+        COUNT
+    };
+
+    // One bound input along with the N64 buttons and stick directions that it drives.
+    struct CompiledBinding {
+        int32_t input_id;
+        uint16_t buttons;
+        uint8_t axes;
+    };
+
+    // The N64 bindings of one device flattened into a list per input type, with each input appearing once. Rebuilt
+    // whenever a binding changes so that reading the N64 inputs doesn't have to walk every binding of every input.
+    struct CompiledBindingList {
+        static constexpr size_t max_entries = static_cast<size_t>(GameInput::COUNT) * bindings_per_input;
+        std::array<CompiledBinding, max_entries> keys;
+        std::array<CompiledBinding, max_entries> controller_buttons;
+        std::array<CompiledBinding, max_entries> controller_axes;
+        size_t num_keys;
+        size_t num_controller_buttons;
+        size_t num_controller_axes;
+    };
+
+    struct CompiledBindings {
+        std::array<CompiledBindingList, static_cast<size_t>(InputDevice::COUNT)> devices;
+    };
+
+    struct N64InputState {
+        uint16_t buttons;
+        std::array<float, static_cast<size_t>(N64Axis::COUNT)> axes;
+    };
+
+    void add_compiled_binding(CompiledBindingList& list, const InputField& field, uint16_t buttons, uint8_t axes);
+    // Evaluates every device's bindings against the same input snapshot.
+    void evaluate_compiled_bindings(int port, const CompiledBindings& bindings,
+        std::array<N64InputState, static_cast<size_t>(InputDevice::COUNT)>& states_out);
+
     bool get_n64_input(int controller_num, uint16_t* buttons_out, float* x_out, float* y_out);
     void set_rumble(int controller_num, bool);
     void update_rumble();
+    // Starts and stops the thread that sends rumble to the controllers.
+    void start_haptics();
+    void stop_haptics();
     void handle_events();
 
     ultramodern::input::connected_device_info_t get_connected_device_info(int controller_num);
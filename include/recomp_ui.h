@@ -40,6 +40,10 @@ namespace recompui {
 
     using event_handler_t = void(const std::string& param, Rml::Event&);
 
+    // Normalized stick deflection past which the UI navigates, and below which the stick counts as returned to the center.
+    constexpr float stick_navigate_threshold = 0.5f;
+    constexpr float stick_return_threshold = 0.15f;
+
     void queue_event(const SDL_Event& event);
     bool try_deque_event(SDL_Event& out);
 
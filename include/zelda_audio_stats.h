@@ -0,0 +1,50 @@
+#ifndef __ZELDA_AUDIO_STATS_H__
+#define __ZELDA_AUDIO_STATS_H__
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "zelda_stats_histogram.h"
+
+namespace zelda64 {
+    namespace audio {
+        using zelda64::HistogramSnapshot;
+
+        struct StatsSnapshot {
+            // Number of calls to queue_samples.
+            uint64_t chunks_queued;
+            // Chunks dropped because the output queue was far above the latency target.
+            uint64_t chunks_dropped;
+            // Chunks where the rate controller applied its largest adjustment.
+            uint64_t rate_saturated;
+            // Times the output device ran out of audio.
+            uint64_t device_underruns;
+            // Audio queued at the output when a chunk arrives, in microseconds.
+            HistogramSnapshot queued_us;
+            // Absolute deviation of the resampling ratio applied by the rate controller, in parts per million.
+            HistogramSnapshot rate_adjust_ppm;
+            // Time spent converting a chunk to floats, in nanoseconds.
+            HistogramSnapshot convert_ns;
+            // Values returned to the game by get_frames_remaining.
+            HistogramSnapshot frames_remaining;
+        };
+
+        // Recording functions. These only use relaxed atomics so they can be called from the audio thread on every chunk.
+        void record_queued_chunk(uint64_t queued_us, double rate_adjust, bool rate_saturated);
+        void record_dropped_chunk();
+        void record_device_underrun();
+        void record_convert_time(uint64_t nanoseconds);
+        void record_frames_remaining(uint64_t frames);
+
+        StatsSnapshot get_stats();
+        void reset_stats();
+        // Human-readable summary of the stats, one entry per line.
+        std::vector<std::string> format_stats(const StatsSnapshot& stats);
+        // Writes the summary followed by the full histograms to the given path. Returns false on failure.
+        bool dump_stats(const std::filesystem::path& path);
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __ZELDA_INPUT_LATENCY_H__
+#define __ZELDA_INPUT_LATENCY_H__
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "zelda_stats_histogram.h"
+
+namespace zelda64 {
+    namespace input {
+        // Latency is traced for one input event at a time: the oldest event that arrived since the last poll is
+        // followed through the poll that snapshots it, the first game read of that snapshot and the next present.
+        // Events that arrive while one is already being traced are only counted.
+        struct LatencyStats {
+            // Number of input events seen. While the controller pump thread runs, each poll whose controller state
+            // changed counts as one event rather than each of the controller's SDL events.
+            uint64_t events;
+            // Number of motion events merged into an earlier one before being sent to the UI.
+            uint64_t coalesced_events;
+            // Time from an input event to the poll that captured it, in microseconds.
+            HistogramSnapshot event_to_poll_us;
+            // Time from an input event to the game reading the controller, in microseconds.
+            HistogramSnapshot event_to_read_us;
+            // Time from an input event to the next frame presented after the game read it, in microseconds.
+            HistogramSnapshot event_to_present_us;
+        };
+
+        // Recording functions. These only use atomics so they're safe to call from the event, game and gfx threads.
+        // age_us is how long the event sat in SDL's queue before being handled.
+        void record_event(uint64_t age_us);
+        void record_poll();
+        void record_read();
+        void record_present();
+        void record_coalesced_event();
+
+        // Controller state that the pump thread refreshes can reach a snapshot before the gfx thread dispatches the
+        // matching SDL event, so while the pump thread runs controller changes are traced through the snapshots
+        // instead of the events. The pump thread calls record_controller_change when it sees a controller's state
+        // change. Each poll takes the time of the first such change before reading the controllers, and if the new
+        // snapshot's controller state differs from the previous one, traces it with record_controller_event. A change
+        // the pump thread didn't see, e.g. one made by the gfx thread's event pumping, is traced from the poll itself.
+        void record_controller_change();
+        uint64_t take_controller_change();
+        void record_controller_event(uint64_t change_us);
+
+        LatencyStats get_latency_stats();
+        void reset_latency_stats();
+        // Human-readable summary of the stats, one entry per line.
+        std::vector<std::string> format_latency_stats(const LatencyStats& stats);
+        // Writes the histograms to the given path as CSV. Returns false on failure.
+        bool dump_latency_stats(const std::filesystem::path& path);
+    }
+}
+
+#endif
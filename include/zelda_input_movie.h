@@ -0,0 +1,35 @@
+#ifndef __ZELDA_INPUT_MOVIE_H__
+#define __ZELDA_INPUT_MOVIE_H__
+
+#include <cstdint>
+#include <filesystem>
+
+namespace zelda64 {
+    namespace input {
+        // Input movies hold the controller state that get_n64_input returned for every port, keyed by the index of the
+        // game's input poll. Only changes are stored, so a movie of mostly idle input stays small. Playing one back
+        // with the same boot reproduces the run.
+
+        // Starts streaming the inputs read by the game to the given path. Returns false if the file couldn't be opened.
+        bool start_movie_recording(const std::filesystem::path& path);
+        // Loads the movie at the given path and substitutes its inputs for the real ones. Returns false if the file
+        // couldn't be read or isn't a movie.
+        bool start_movie_playback(const std::filesystem::path& path);
+        // Stops recording or playback. Recording flushes any pending inputs and finalizes the file header.
+        void stop_movie();
+
+        // Called from the game thread at the start of every input poll.
+        void advance_movie_poll();
+
+        bool movie_recording();
+        bool movie_playing();
+        // Called from the game thread with the state of a port every time get_n64_input reads it while recording.
+        void record_movie_input(int port, bool connected, uint16_t buttons, float x, float y);
+        // The recorded state of a port for the current poll. Returns whether the port was connected.
+        bool get_movie_input(int port, uint16_t* buttons_out, float* x_out, float* y_out);
+        // Whether the port was connected at any point in the movie being played.
+        bool movie_port_used(int port);
+    }
+}
+
+#endif
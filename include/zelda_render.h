@@ -1,8 +1,10 @@
 #ifndef __ZELDA_RENDER_H__
 #define __ZELDA_RENDER_H__
 
+#include <cstdio>
 #include <unordered_set>
 #include <filesystem>
+#include <string_view>
 
 #include "common/rt64_user_configuration.h"
 #include "ultramodern/renderer_context.hpp"
@@ -40,6 +42,44 @@ namespace zelda64 {
             void check_texture_pack_actions();
         };
 
+        // Renderer that doesn't use the GPU. Display lists are walked to check that they're well formed and can be
+        // hashed, but nothing is drawn. This allows measuring the game's own throughput on machines without a GPU.
+        class NullContext final : public ultramodern::renderer::RendererContext {
+        public:
+            ~NullContext() override;
+            NullContext(uint8_t *rdram);
+
+            bool valid() override { return true; }
+
+            bool update_config(const ultramodern::renderer::GraphicsConfig &old_config, const ultramodern::renderer::GraphicsConfig &new_config) override { return false; }
+
+            void enable_instant_present() override {}
+            void send_dl(const OSTask *task) override;
+            void update_screen() override {}
+            void shutdown() override;
+            uint32_t get_display_framerate() const override { return 60; }
+            float get_resolution_scale() const override { return 1.0f; }
+
+        private:
+            uint8_t *rdram;
+            FILE *hash_file = nullptr;
+            uint64_t display_list_count = 0;
+            uint64_t command_count = 0;
+            uint64_t invalid_count = 0;
+        };
+
+        enum class RendererType {
+            RT64,
+            Null
+        };
+
+        bool renderer_type_from_string(std::string_view name, RendererType& type_out);
+        // Must be called before the renderer is created.
+        void set_renderer_type(RendererType type);
+        RendererType get_renderer_type();
+        // Makes the null renderer write a hash of every display list it receives to the given path, one per line.
+        void set_display_list_hash_path(const std::filesystem::path& path);
+
         std::unique_ptr<ultramodern::renderer::RendererContext> create_render_context(uint8_t *rdram, ultramodern::renderer::WindowHandle window_handle, bool developer_mode);
 
         RT64::UserConfiguration::Antialiasing RT64MaxMSAA();
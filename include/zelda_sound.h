@@ -1,7 +1,20 @@
 #ifndef __ZELDA_SOUND_H__
 #define __ZELDA_SOUND_H__
 
+#include "json/json.hpp"
+
 namespace zelda64 {
+    enum class ResamplerMode {
+        Linear,
+        Sinc,
+        OptionCount
+    };
+
+    NLOHMANN_JSON_SERIALIZE_ENUM(zelda64::ResamplerMode, {
+        {zelda64::ResamplerMode::Linear, "Linear"},
+        {zelda64::ResamplerMode::Sinc, "Sinc"}
+    });
+
     void reset_sound_settings();
     void set_main_volume(int volume);
     int get_main_volume();
@@ -9,6 +22,13 @@ namespace zelda64 {
     int get_bgm_volume();
     void set_low_health_beeps_enabled(bool enabled);
     bool get_low_health_beeps_enabled();
+    void set_resampler_mode(ResamplerMode mode);
+    ResamplerMode get_resampler_mode();
+    // Target amount of queued audio, in milliseconds. Values outside of the range the sound menu allows are clamped.
+    constexpr int min_audio_latency = 20;
+    constexpr int max_audio_latency = 200;
+    void set_audio_latency(int latency_ms);
+    int get_audio_latency();
 }
 
 #endif
@@ -0,0 +1,106 @@
+#ifndef __ZELDA_STATS_HISTOGRAM_H__
+#define __ZELDA_STATS_HISTOGRAM_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace zelda64 {
+    // Histograms use power-of-two buckets: bucket 0 counts zeroes and bucket N counts values in [2^(N-1), 2^N).
+    constexpr size_t stats_histogram_buckets = 32;
+
+    struct HistogramSnapshot {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        std::array<uint64_t, stats_histogram_buckets> buckets;
+
+        uint64_t mean() const {
+            return count == 0 ? 0 : sum / count;
+        }
+
+        // Upper bound of the bucket that contains the given percentile (0.0-1.0).
+        uint64_t percentile(double fraction) const {
+            if (count == 0) {
+                return 0;
+            }
+
+            uint64_t target = uint64_t(std::ceil(double(count) * fraction));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < stats_histogram_buckets; i++) {
+                seen += buckets[i];
+                if (seen >= target && buckets[i] != 0) {
+                    // Report the bucket's upper bound, clamped to the largest value actually recorded.
+                    return std::min(bucket_high(i), max);
+                }
+            }
+            return max;
+        }
+
+        static uint64_t bucket_low(size_t bucket) {
+            return (bucket == 0) ? 0 : (uint64_t{1} << (bucket - 1));
+        }
+
+        static uint64_t bucket_high(size_t bucket) {
+            return (bucket == 0) ? 0 : (uint64_t{1} << bucket) - 1;
+        }
+    };
+
+    // Histogram that can be recorded into from any thread. Only relaxed atomics are used, so a snapshot taken while
+    // values are being recorded may be slightly inconsistent.
+    class Histogram {
+    public:
+        void record(uint64_t value) {
+            size_t bucket = std::min<size_t>(std::bit_width(value), stats_histogram_buckets - 1);
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(value, std::memory_order_relaxed);
+
+            uint64_t cur_max = max.load(std::memory_order_relaxed);
+            while (value > cur_max && !max.compare_exchange_weak(cur_max, value, std::memory_order_relaxed)) {}
+        }
+
+        HistogramSnapshot snapshot() const {
+            HistogramSnapshot ret{};
+            ret.count = count.load(std::memory_order_relaxed);
+            ret.sum = sum.load(std::memory_order_relaxed);
+            ret.max = max.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < stats_histogram_buckets; i++) {
+                ret.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+        void reset() {
+            count.store(0, std::memory_order_relaxed);
+            sum.store(0, std::memory_order_relaxed);
+            max.store(0, std::memory_order_relaxed);
+            for (auto& bucket : buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        std::atomic<uint64_t> count{};
+        std::atomic<uint64_t> sum{};
+        std::atomic<uint64_t> max{};
+        std::array<std::atomic<uint64_t>, stats_histogram_buckets> buckets{};
+    };
+
+    // One-line summary of a histogram, prefixed with the given name.
+    inline std::string format_histogram(const char* name, const HistogramSnapshot& histogram) {
+        char line[256];
+        snprintf(line, sizeof(line), "%s: mean %llu, p50 %llu, p99 %llu, max %llu (%llu samples)", name,
+            (unsigned long long)histogram.mean(), (unsigned long long)histogram.percentile(0.5),
+            (unsigned long long)histogram.percentile(0.99), (unsigned long long)histogram.max,
+            (unsigned long long)histogram.count);
+        return line;
+    }
+}
+
+#endif
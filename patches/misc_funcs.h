@@ -8,4 +8,7 @@ DECLARE_FUNC(void, recomp_puts, const char* data, u32 size);
 DECLARE_FUNC(void, recomp_exit);
 #endif
 
+DECLARE_FUNC(long, recomp_load_mus_sample, long addr, long len, void* slots);
+DECLARE_FUNC(void, recomp_mus_sample_new_frame);
+
 #endif
@@ -0,0 +1,13 @@
+#ifndef __MUS_DMA_H__
+#define __MUS_DMA_H__
+
+// Layout of the resident sample pages that the music driver's DMA requests are served from. Shared between the
+// patches, which own the pages' memory, and recomp_load_mus_sample, which manages them.
+
+// Size of the ROM page that a slot is keyed by.
+#define MUS_SAMPLE_PAGE_SIZE 0x1000
+// A slot holds its page and the following one, so any request that starts in the page and is no longer than a page fits.
+#define MUS_SAMPLE_SLOT_SIZE (2 * MUS_SAMPLE_PAGE_SIZE)
+#define MUS_SAMPLE_SLOT_COUNT 64
+
+#endif
@@ -0,0 +1,18 @@
+#include "patches.h"
+#include "misc_funcs.h"
+#include "mus_dma.h"
+
+// Resident copies of the ROM pages that hold sample data, managed by recomp_load_mus_sample.
+static unsigned char mus_sample_slots[MUS_SAMPLE_SLOT_COUNT][MUS_SAMPLE_SLOT_SIZE] __attribute__((aligned(16)));
+
+// @recomp Serve the synthesizer's sample requests from resident ROM pages instead of going through libmus's DMA buffer
+// cache, which issues a PI DMA and waits on its message queue for every miss. Returns the physical address of the data.
+RECOMP_PATCH long __MusIntDmaSample_0006BC9C(long addr, long len, void* state) {
+    return recomp_load_mus_sample(addr, len, mus_sample_slots);
+}
+
+// @recomp libmus calls this once per audio frame to free the DMA buffers that haven't been used for a while. Sample
+// requests no longer go through those buffers, so mark the start of a new frame for the resident pages instead.
+RECOMP_PATCH void __MusIntDmaProcess(void) {
+    recomp_mus_sample_new_frame();
+}
@@ -22,4 +22,6 @@
         EXTERNC void name(uint8_t* rdram, recomp_context* ctx)
 #endif
 
+#define RECOMP_PATCH __attribute__((section(".recomp_patch")))
+
 #endif
@@ -460,6 +460,8 @@ bool save_sound_config(const std::filesystem::path& path) {
     config_json["main_volume"] = zelda64::get_main_volume();
     config_json["bgm_volume"] = zelda64::get_bgm_volume();
     config_json["low_health_beeps"] = zelda64::get_low_health_beeps_enabled();
+    config_json["resampler_mode"] = zelda64::get_resampler_mode();
+    config_json["audio_latency"] = zelda64::get_audio_latency();
 
     return save_json_with_backups(path, config_json);
 }
@@ -474,6 +476,8 @@ bool load_sound_config(const std::filesystem::path& path) {
     call_if_key_exists(zelda64::set_main_volume, config_json, "main_volume");
     call_if_key_exists(zelda64::set_bgm_volume, config_json, "bgm_volume");
     call_if_key_exists(zelda64::set_low_health_beeps_enabled, config_json, "low_health_beeps");
+    call_if_key_exists(zelda64::set_resampler_mode, config_json, "resampler_mode");
+    call_if_key_exists(zelda64::set_audio_latency, config_json, "audio_latency");
     return true;
 }
 
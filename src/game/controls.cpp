@@ -1,7 +1,11 @@
 #include <array>
+#include <atomic>
+#include <mutex>
 
 #include "librecomp/helpers.hpp"
 #include "recomp_input.h"
+#include "zelda_input_latency.h"
+#include "zelda_input_movie.h"
 #include "ultramodern/ultramodern.hpp"
 
 // Arrays that hold the mappings for every input for keyboard and controller respectively.
@@ -17,6 +21,71 @@ static const std::array n64_button_values = {
 };
 #undef DEFINE_INPUT
 
+// The stick direction that each axis input drives.
+static const std::array<std::pair<recomp::GameInput, recomp::N64Axis>, 4> n64_axis_inputs = {{
+    { recomp::GameInput::X_AXIS_POS, recomp::N64Axis::XPos },
+    { recomp::GameInput::X_AXIS_NEG, recomp::N64Axis::XNeg },
+    { recomp::GameInput::Y_AXIS_POS, recomp::N64Axis::YPos },
+    { recomp::GameInput::Y_AXIS_NEG, recomp::N64Axis::YNeg },
+}};
+
+// Compiled copies of the mappings, which are what get_n64_input reads. They're published the same way as input
+// snapshots: a new copy is written to the next slot and then the generation is bumped, and readers retry if the slot
+// they were reading got rewritten.
+constexpr size_t compiled_bindings_count = 3;
+
+static struct {
+    std::mutex compile_mutex;
+    std::array<recomp::CompiledBindings, compiled_bindings_count> bindings{};
+    std::atomic<uint64_t> generation = 0;
+} CompiledBindingsState;
+
+static void compile_bindings() {
+    std::lock_guard lock{ CompiledBindingsState.compile_mutex };
+    uint64_t next_generation = CompiledBindingsState.generation.load(std::memory_order_relaxed) + 1;
+    recomp::CompiledBindings& compiled = CompiledBindingsState.bindings[next_generation % compiled_bindings_count];
+
+    const std::array<const input_mapping_array*, static_cast<size_t>(recomp::InputDevice::COUNT)> device_mappings = {
+        &controller_input_mappings, // InputDevice::Controller
+        &keyboard_input_mappings,   // InputDevice::Keyboard
+    };
+
+    for (size_t device = 0; device < device_mappings.size(); device++) {
+        recomp::CompiledBindingList& list = compiled.devices[device];
+        const input_mapping_array& mappings = *device_mappings[device];
+        list.num_keys = 0;
+        list.num_controller_buttons = 0;
+        list.num_controller_axes = 0;
+
+        for (size_t i = 0; i < n64_button_values.size(); i++) {
+            size_t input_index = (size_t)recomp::GameInput::N64_BUTTON_START + i;
+            for (const recomp::InputField& field : mappings[input_index]) {
+                recomp::add_compiled_binding(list, field, n64_button_values[i], 0);
+            }
+        }
+
+        for (const auto& [input, axis] : n64_axis_inputs) {
+            for (const recomp::InputField& field : mappings[static_cast<size_t>(input)]) {
+                recomp::add_compiled_binding(list, field, 0, uint8_t(1u << static_cast<size_t>(axis)));
+            }
+        }
+    }
+
+    CompiledBindingsState.generation.store(next_generation, std::memory_order_release);
+}
+
+template <typename Func>
+static auto read_compiled_bindings(Func&& func) {
+    while (true) {
+        uint64_t generation = CompiledBindingsState.generation.load(std::memory_order_acquire);
+        auto ret = func(CompiledBindingsState.bindings[generation % compiled_bindings_count]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (CompiledBindingsState.generation.load(std::memory_order_relaxed) - generation < compiled_bindings_count - 1) {
+            return ret;
+        }
+    }
+}
+
 // Make the input name array.
 #define DEFINE_INPUT(name, value, readable) readable,
 static const std::vector<std::string> input_names = {
@@ -72,6 +141,7 @@ void recomp::set_input_binding(recomp::GameInput input, size_t binding_index, re
 
     if (binding_index < cur_input_mapping.size()) {
         cur_input_mapping[binding_index] = value;
+        compile_bindings();
     }
 }
 
@@ -80,37 +150,55 @@ bool recomp::get_n64_input(int controller_num, uint16_t* buttons_out, float* x_o
     float cur_x = 0.0f;
     float cur_y = 0.0f;
     
-    if (controller_num != 0) {
+    if (controller_num < 0 || controller_num >= recomp::num_n64_ports) {
         return false;
     }
 
-    if (!recomp::game_input_disabled()) {
-        for (size_t i = 0; i < n64_button_values.size(); i++) {
-            size_t input_index = (size_t)GameInput::N64_BUTTON_START + i;
-            cur_buttons |= recomp::get_input_digital(keyboard_input_mappings[input_index]) ? n64_button_values[i] : 0;
-            cur_buttons |= recomp::get_input_digital(controller_input_mappings[input_index]) ? n64_button_values[i] : 0;
-        }
+    if (zelda64::input::movie_playing()) {
+        return zelda64::input::get_movie_input(controller_num, buttons_out, x_out, y_out);
+    }
 
-        float joystick_deadzone = recomp::get_joystick_deadzone() / 100.0f;
+    // The controllers are read in port order, so sample once per read at the first port.
+    if (controller_num == 0) {
+        recomp::sample_inputs_for_read();
+    }
 
-        float joystick_x = recomp::get_input_analog(controller_input_mappings[(size_t)GameInput::X_AXIS_POS])
-                        - recomp::get_input_analog(controller_input_mappings[(size_t)GameInput::X_AXIS_NEG]);
+    if (recomp::get_connected_device_info(controller_num).connected_device == ultramodern::input::Device::None) {
+        zelda64::input::record_movie_input(controller_num, false, 0, 0.0f, 0.0f);
+        return false;
+    }
 
-        float joystick_y = recomp::get_input_analog(controller_input_mappings[(size_t)GameInput::Y_AXIS_POS])
-                        - recomp::get_input_analog(controller_input_mappings[(size_t)GameInput::Y_AXIS_NEG]);
+    if (!recomp::game_input_disabled()) {
+        auto states = read_compiled_bindings([&](const recomp::CompiledBindings& bindings) {
+            std::array<recomp::N64InputState, static_cast<size_t>(recomp::InputDevice::COUNT)> ret;
+            recomp::evaluate_compiled_bindings(controller_num, bindings, ret);
+            return ret;
+        });
+        zelda64::input::record_read();
+        const recomp::N64InputState& keyboard_state = states[static_cast<size_t>(recomp::InputDevice::Keyboard)];
+        const recomp::N64InputState& controller_state = states[static_cast<size_t>(recomp::InputDevice::Controller)];
+        auto axis_value = [](const recomp::N64InputState& state, recomp::N64Axis axis) {
+            return state.axes[static_cast<size_t>(axis)];
+        };
+
+        cur_buttons = keyboard_state.buttons | controller_state.buttons;
+
+        float joystick_x = axis_value(controller_state, recomp::N64Axis::XPos) - axis_value(controller_state, recomp::N64Axis::XNeg);
+        float joystick_y = axis_value(controller_state, recomp::N64Axis::YPos) - axis_value(controller_state, recomp::N64Axis::YNeg);
 
         recomp::apply_joystick_deadzone(joystick_x, joystick_y, &joystick_x, &joystick_y);
 
-        cur_x = recomp::get_input_analog(keyboard_input_mappings[(size_t)GameInput::X_AXIS_POS])
-                - recomp::get_input_analog(keyboard_input_mappings[(size_t)GameInput::X_AXIS_NEG]) + joystick_x;
-
-        cur_y = recomp::get_input_analog(keyboard_input_mappings[(size_t)GameInput::Y_AXIS_POS])
-                - recomp::get_input_analog(keyboard_input_mappings[(size_t)GameInput::Y_AXIS_NEG]) + joystick_y;
+        cur_x = axis_value(keyboard_state, recomp::N64Axis::XPos) - axis_value(keyboard_state, recomp::N64Axis::XNeg) + joystick_x;
+        cur_y = axis_value(keyboard_state, recomp::N64Axis::YPos) - axis_value(keyboard_state, recomp::N64Axis::YNeg) + joystick_y;
     }
 
     *buttons_out = cur_buttons;
     *x_out = std::clamp(cur_x, -1.0f, 1.0f);
     *y_out = std::clamp(cur_y, -1.0f, 1.0f);
 
+    if (zelda64::input::movie_recording()) {
+        zelda64::input::record_movie_input(controller_num, true, *buttons_out, *x_out, *y_out);
+    }
+
     return true;
 }
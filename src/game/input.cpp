@@ -1,51 +1,259 @@
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <string>
+#include <thread>
 
 #include "ultramodern/ultramodern.hpp"
 #include "recomp.h"
 #include "recomp_input.h"
+#include "zelda_input_latency.h"
+#include "zelda_input_movie.h"
 #include "zelda_config.h"
 #include "recomp_ui.h"
 #include "SDL.h"
 #include "promptfont.h"
 #include "GamepadMotion.hpp"
+#include "../main/spsc_ring_buffer.h"
 
 constexpr float axis_threshold = 0.5f;
 
-struct ControllerState {
-    SDL_GameController* controller;
+// Connected controllers and the ports they're assigned to.
+using ControllerList = std::vector<std::pair<SDL_GameController*, int>>;
+
+// Fixed set of slots that hold the connected controllers. Controllers are only added and removed by the event thread,
+// and any thread can read the slots without locking. Each slot's generation is odd while it holds a controller and is
+// bumped on every add and remove, so a reader can tell when a slot changed under it. The epoch is bumped after every
+// add and remove, which lets readers keep their own copy of the controller list and only rebuild it on hotplug.
+class ControllerRegistry {
+public:
+    static constexpr size_t capacity = 16;
+
+    // Event thread only. Returns false if every slot is in use.
+    bool add(SDL_JoystickID id, SDL_GameController* controller, int port) {
+        // SDL can report a controller as added more than once, keep the slot it already has.
+        for (const Slot& slot : slots) {
+            if ((slot.generation.load(std::memory_order_relaxed) & 1) != 0 && slot.id.load(std::memory_order_relaxed) == id) {
+                return true;
+            }
+        }
+
+        for (Slot& slot : slots) {
+            uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+            if ((generation & 1) == 0) {
+                slot.id.store(id, std::memory_order_relaxed);
+                slot.controller.store(controller, std::memory_order_relaxed);
+                slot.port.store(port, std::memory_order_relaxed);
+                slot.generation.store(generation + 1, std::memory_order_release);
+                cur_epoch.fetch_add(1, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Event thread only. Returns false if no slot holds the given controller.
+    bool remove(SDL_JoystickID id, SDL_GameController** controller_out, int* port_out) {
+        for (Slot& slot : slots) {
+            uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+            if ((generation & 1) != 0 && slot.id.load(std::memory_order_relaxed) == id) {
+                *controller_out = slot.controller.load(std::memory_order_relaxed);
+                *port_out = slot.port.load(std::memory_order_relaxed);
+                slot.generation.store(generation + 1, std::memory_order_release);
+                cur_epoch.fetch_add(1, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Event thread only, as the slots can't change while it runs.
+    template <typename Func>
+    void for_each(Func&& func) const {
+        for (const Slot& slot : slots) {
+            if ((slot.generation.load(std::memory_order_relaxed) & 1) != 0) {
+                func(slot.controller.load(std::memory_order_relaxed), slot.port.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    uint64_t epoch() const {
+        return cur_epoch.load(std::memory_order_acquire);
+    }
+
+    // Any thread. Fills the list with the connected controllers and returns the epoch that the list reflects.
+    uint64_t collect(ControllerList& out) const {
+        uint64_t start_epoch = epoch();
+        out.clear();
+        for (const Slot& slot : slots) {
+            uint32_t generation = slot.generation.load(std::memory_order_acquire);
+            if ((generation & 1) == 0) {
+                continue;
+            }
+            SDL_GameController* controller = slot.controller.load(std::memory_order_relaxed);
+            int port = slot.port.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Skip the slot if it was removed while being read. If it was reused, the epoch will have changed and the
+            // next refresh picks up the new controller.
+            if (slot.generation.load(std::memory_order_relaxed) == generation) {
+                out.emplace_back(controller, port);
+            }
+        }
+        return start_epoch;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> generation{};
+        std::atomic<SDL_JoystickID> id{};
+        std::atomic<SDL_GameController*> controller{};
+        std::atomic<int> port{};
+    };
+
+    std::array<Slot, capacity> slots{};
+    std::atomic<uint64_t> cur_epoch{};
+};
+
+// A thread's copy of the controller list, rebuilt only when the registry changes.
+struct CachedControllerList {
+    uint64_t epoch = UINT64_MAX;
+    ControllerList controllers;
+
+    const ControllerList& update(const ControllerRegistry& registry) {
+        if (registry.epoch() != epoch) {
+            epoch = registry.collect(controllers);
+        }
+        return controllers;
+    }
+};
+
+// Sensor fusion state of a controller with motion sensors. Only used by the game thread.
+struct MotionState {
     std::array<float, 3> latest_accelerometer;
     GamepadMotion motion;
     uint32_t prev_gyro_timestamp;
-    ControllerState() : controller{}, latest_accelerometer{}, motion{}, prev_gyro_timestamp{} {
+    MotionState() : latest_accelerometer{}, motion{}, prev_gyro_timestamp{} {
         motion.Reset();
         motion.SetCalibrationMode(GamepadMotionHelpers::CalibrationMode::Stillness | GamepadMotionHelpers::CalibrationMode::SensorFusion);
     };
 };
 
+// A motion sensor reading, passed from the event thread to the game thread which runs the sensor fusion on it.
+struct SensorSample {
+    SDL_JoystickID which;
+    // SDL_SENSOR_INVALID marks the controller as removed, which discards its motion state.
+    SDL_SensorType sensor;
+    uint32_t timestamp;
+    std::array<float, 3> data;
+};
+
+// Number of sensor samples that can be waiting for the game thread. Controllers send up to about 1000 samples a
+// second per sensor, so this covers a couple of seconds without polls. Samples beyond that are dropped.
+constexpr size_t sensor_sample_queue_size = 4096;
+
+// Sum of two values that can be added to from one thread and taken from another without locking. The values are
+// stored as 32.32 fixed point so that additions and the swap on take are single atomic operations.
+class DeltaAccumulator {
+public:
+    void add(float x, float y) {
+        values[0].fetch_add(to_fixed(x), std::memory_order_relaxed);
+        values[1].fetch_add(to_fixed(y), std::memory_order_relaxed);
+    }
+
+    // Returns the current sums and resets them to zero.
+    std::array<float, 2> take() {
+        return {
+            from_fixed(values[0].exchange(0, std::memory_order_relaxed)),
+            from_fixed(values[1].exchange(0, std::memory_order_relaxed)),
+        };
+    }
+
+private:
+    static constexpr double fixed_scale = 4294967296.0;
+    static int64_t to_fixed(float value) { return int64_t(double(value) * fixed_scale); }
+    static float from_fixed(int64_t value) { return float(double(value) / fixed_scale); }
+
+    std::array<std::atomic<int64_t>, 2> values{};
+};
+
 static struct {
     const Uint8* keys = nullptr;
     SDL_Keymod keymod = SDL_Keymod::KMOD_NONE;
     int numkeys = 0;
     std::atomic_int32_t mouse_wheel_pos = 0;
-    std::mutex cur_controllers_mutex;
-    std::vector<SDL_GameController*> cur_controllers{};
-    std::unordered_map<SDL_JoystickID, ControllerState> controller_states;
+    ControllerRegistry controllers;
+    // The game thread's copy of the controller list for taking snapshots.
+    CachedControllerList snapshot_controllers;
+    // Last port used by each controller model, identified by its GUID, so that a controller that's unplugged and
+    // plugged back in returns to the same port.
+    std::unordered_map<std::string, int> previous_ports;
     
     std::array<float, 2> rotation_delta{};
     std::array<float, 2> mouse_delta{};
-    std::mutex pending_input_mutex;
-    std::array<float, 2> pending_rotation_delta{};
-    std::array<float, 2> pending_mouse_delta{};
-
-    float cur_rumble;
-    bool rumble_active;
+    // Written by the event thread and read by the game thread's poll.
+    zelda64::SpscRingBuffer<SensorSample> sensor_samples{sensor_sample_queue_size};
+    DeltaAccumulator pending_mouse_delta;
+    // Only used by the game thread.
+    std::unordered_map<SDL_JoystickID, MotionState> motion_states;
+
+    std::array<float, recomp::num_n64_ports> cur_rumble;
+    std::array<bool, recomp::num_n64_ports> rumble_active;
 } InputState;
 
 static struct {
     std::list<std::filesystem::path> files_dropped;
 } DropState;
 
+// Controller state of a single N64 port.
+struct PortSnapshot {
+    // Whether each button is held on any of the port's controllers.
+    std::array<bool, SDL_CONTROLLER_BUTTON_MAX> buttons;
+    // Sum across the port's controllers of each axis clamped to its positive and negative range respectively.
+    std::array<float, SDL_CONTROLLER_AXIS_MAX> axis_positive;
+    std::array<float, SDL_CONTROLLER_AXIS_MAX> axis_negative;
+
+    bool operator==(const PortSnapshot& rhs) const = default;
+};
+
+// Immutable copy of every keyboard key, controller button and axis, taken once per poll so that evaluating bindings
+// doesn't need to lock the controller list or query SDL.
+struct InputSnapshot {
+    std::array<uint8_t, SDL_NUM_SCANCODES> keys;
+    SDL_Keymod keymod;
+    std::array<PortSnapshot, recomp::num_n64_ports> ports;
+    // Bit mask of the ports that have a controller or the keyboard assigned.
+    uint32_t connected_ports;
+};
+
+// Snapshots are written round robin and published by bumping the generation. A snapshot is only rewritten two polls
+// after it was published, and readers retry if that happened while they were reading it.
+constexpr size_t input_snapshot_count = 3;
+
+static struct {
+    std::array<InputSnapshot, input_snapshot_count> snapshots{};
+    std::atomic<uint64_t> generation = 0;
+} InputSnapshots;
+
+template <typename Func>
+static auto read_input_snapshot(Func&& func) {
+    while (true) {
+        uint64_t generation = InputSnapshots.generation.load(std::memory_order_acquire);
+        auto ret = func(InputSnapshots.snapshots[generation % input_snapshot_count]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (InputSnapshots.generation.load(std::memory_order_relaxed) - generation < input_snapshot_count - 1) {
+            return ret;
+        }
+    }
+}
+
+static struct {
+    std::atomic<bool> just_in_time = false;
+    std::atomic<bool> pump_running = false;
+    std::thread pump_thread;
+} InputSampling;
+
 std::atomic<recomp::InputDevice> scanning_device = recomp::InputDevice::COUNT;
 std::atomic<recomp::InputField> scanned_input;
 
@@ -77,9 +285,105 @@ void recomp::stop_scanning_input() {
     scanning_device.store(recomp::InputDevice::COUNT);
 }
 
+// Motion events waiting to be sent to the UI. Consecutive motion events from the same source are merged into one so
+// that bursts of them don't flood the UI queue, unless the UI would react to them differently. Any other event sends
+// the waiting ones first, which keeps the order of button presses and releases relative to motion exact.
+constexpr size_t max_pending_ui_motion_events = 16;
+
+static struct {
+    std::array<SDL_Event, max_pending_ui_motion_events> events;
+    size_t count = 0;
+} PendingUIMotion;
+
+static bool is_ui_motion_event(const SDL_Event& event) {
+    return event.type == SDL_EventType::SDL_MOUSEMOTION || event.type == SDL_EventType::SDL_CONTROLLERAXISMOTION;
+}
+
+static bool is_same_ui_motion_source(const SDL_Event& a, const SDL_Event& b) {
+    if (a.type != b.type) {
+        return false;
+    }
+    if (a.type == SDL_EventType::SDL_MOUSEMOTION) {
+        return a.motion.windowID == b.motion.windowID && a.motion.which == b.motion.which;
+    }
+    return a.caxis.which == b.caxis.which && a.caxis.axis == b.caxis.axis;
+}
+
+// Which of the UI's stick navigation ranges an axis value falls in. The UI acts when the stick moves from one range to
+// another, so merging events from different ranges could lose a navigation.
+static int ui_stick_range(int16_t value) {
+    float axis_value = value * (1 / 32768.0f);
+    if (axis_value > recompui::stick_navigate_threshold) {
+        return 1;
+    }
+    if (axis_value < -recompui::stick_navigate_threshold) {
+        return -1;
+    }
+    if (fabsf(axis_value) < recompui::stick_return_threshold) {
+        return 0;
+    }
+    return 2;
+}
+
+// Merges a motion event into the previous one from the same source. Returns false if merging them would change how
+// the UI reacts to them.
+static bool merge_ui_motion_event(SDL_Event& pending, const SDL_Event& event) {
+    if (event.type == SDL_EventType::SDL_MOUSEMOTION) {
+        if (pending.motion.state != event.motion.state) {
+            return false;
+        }
+        pending.motion.timestamp = event.motion.timestamp;
+        pending.motion.x = event.motion.x;
+        pending.motion.y = event.motion.y;
+        pending.motion.xrel += event.motion.xrel;
+        pending.motion.yrel += event.motion.yrel;
+        return true;
+    }
+    else {
+        if (ui_stick_range(pending.caxis.value) != ui_stick_range(event.caxis.value)) {
+            return false;
+        }
+        pending.caxis.timestamp = event.caxis.timestamp;
+        pending.caxis.value = event.caxis.value;
+        return true;
+    }
+}
+
+static void flush_ui_motion_events() {
+    for (size_t i = 0; i < PendingUIMotion.count; i++) {
+        recompui::queue_event(PendingUIMotion.events[i]);
+    }
+    PendingUIMotion.count = 0;
+}
+
+static void queue_ui_event(const SDL_Event& event) {
+    if (!is_ui_motion_event(event)) {
+        flush_ui_motion_events();
+        recompui::queue_event(event);
+        return;
+    }
+
+    // Only the latest event from the same source can be merged into, as merging into an older one would reorder them.
+    for (size_t i = PendingUIMotion.count; i-- > 0;) {
+        SDL_Event& pending = PendingUIMotion.events[i];
+        if (is_same_ui_motion_source(pending, event)) {
+            if (merge_ui_motion_event(pending, event)) {
+                zelda64::input::record_coalesced_event();
+                return;
+            }
+            break;
+        }
+    }
+
+    if (PendingUIMotion.count == PendingUIMotion.events.size()) {
+        flush_ui_motion_events();
+    }
+    PendingUIMotion.events[PendingUIMotion.count++] = event;
+}
+
 void queue_if_enabled(SDL_Event* event) {
     if (!recomp::all_input_disabled()) {
-        recompui::queue_event(*event);
+        queue_ui_event(*event);
     }
 }
 
@@ -100,7 +404,60 @@ bool should_override_keystate(SDL_Scancode key, SDL_Keymod mod) {
     return false;        
 }
 
+static std::string controller_guid(SDL_GameController* controller) {
+    char guid[33];
+    SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(SDL_GameControllerGetJoystick(controller)), guid, sizeof(guid));
+    return guid;
+}
+
+// Picks the port for a newly connected controller. A controller goes back to the port it last used if that port is
+// free, and otherwise takes the lowest free port. Once all ports are taken, extra controllers share the first port.
+static int assign_controller_port(SDL_GameController* controller) {
+    std::array<bool, recomp::num_n64_ports> port_taken{};
+    InputState.controllers.for_each([&](SDL_GameController* cur_controller, int port) {
+        if (cur_controller != controller) {
+            port_taken[port] = true;
+        }
+    });
+
+    auto previous_it = InputState.previous_ports.find(controller_guid(controller));
+    if (previous_it != InputState.previous_ports.end() && !port_taken[previous_it->second]) {
+        return previous_it->second;
+    }
+
+    for (int port = 0; port < recomp::num_n64_ports; port++) {
+        if (!port_taken[port]) {
+            return port;
+        }
+    }
+
+    return 0;
+}
+
+// Events that get timestamped for the input latency stats.
+static bool is_traced_input_event(const SDL_Event* event) {
+    switch (event->type) {
+    case SDL_EventType::SDL_KEYDOWN:
+        return !event->key.repeat;
+    case SDL_EventType::SDL_KEYUP:
+        return true;
+    case SDL_EventType::SDL_CONTROLLERBUTTONDOWN:
+    case SDL_EventType::SDL_CONTROLLERBUTTONUP:
+    case SDL_EventType::SDL_CONTROLLERAXISMOTION:
+        // The pump thread's controller updates are traced through the snapshots, see take_input_snapshot.
+        return !InputSampling.pump_running.load(std::memory_order_relaxed);
+    default:
+        return false;
+    }
+}
+
 bool sdl_event_filter(void* userdata, SDL_Event* event) {
+    if (is_traced_input_event(event)) {
+        // Account for the time the event spent in SDL's queue before it got here.
+        uint32_t age_ms = SDL_GetTicks() - event->common.timestamp;
+        zelda64::input::record_event(uint64_t(age_ms) * 1000);
+    }
+
     switch (event->type) {
     case SDL_EventType::SDL_KEYDOWN:
         {
@@ -137,8 +494,13 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
             printf("Controller added: %d\n", controller_event->which);
             if (controller != nullptr) {
                 printf("  Instance ID: %d\n", SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller)));
-                ControllerState& state = InputState.controller_states[SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller))];
-                state.controller = controller;
+                int port = assign_controller_port(controller);
+                if (InputState.controllers.add(SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller)), controller, port)) {
+                    printf("  Port: %d\n", port + 1);
+                }
+                else {
+                    printf("  Ignored, too many controllers are connected\n");
+                }
 
                 if (SDL_GameControllerHasSensor(controller, SDL_SensorType::SDL_SENSOR_GYRO) && SDL_GameControllerHasSensor(controller, SDL_SensorType::SDL_SENSOR_ACCEL)) {
                     SDL_GameControllerSetSensorEnabled(controller, SDL_SensorType::SDL_SENSOR_GYRO, SDL_TRUE);
@@ -151,7 +513,13 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
         {
             SDL_ControllerDeviceEvent* controller_event = &event->cdevice;
             printf("Controller removed: %d\n", controller_event->which);
-            InputState.controller_states.erase(controller_event->which);
+            SDL_GameController* controller;
+            int port;
+            if (InputState.controllers.remove(controller_event->which, &controller, &port)) {
+                InputState.previous_ports[controller_guid(controller)] = port;
+            }
+            SensorSample removed_sample{ .which = controller_event->which, .sensor = SDL_SensorType::SDL_SENSOR_INVALID };
+            InputState.sensor_samples.write(&removed_sample, 1);
         }
         break;
     case SDL_EventType::SDL_QUIT: {
@@ -215,7 +583,7 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
                 set_stick_return_event.user.code = axis_event->axis;
                 set_stick_return_event.user.data1 = nullptr;
                 set_stick_return_event.user.data2 = nullptr;
-                recompui::queue_event(set_stick_return_event);
+                queue_ui_event(set_stick_return_event);
                 
                 set_scanned_input({(uint32_t)InputType::ControllerAnalog, axis_event->axis + 1});
             }
@@ -225,7 +593,7 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
                 set_stick_return_event.user.code = axis_event->axis;
                 set_stick_return_event.user.data1 = nullptr;
                 set_stick_return_event.user.data2 = nullptr;
-                recompui::queue_event(set_stick_return_event);
+                queue_ui_event(set_stick_return_event);
 
                 set_scanned_input({(uint32_t)InputType::ControllerAnalog, -axis_event->axis - 1});
             }
@@ -234,46 +602,21 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
         }
         break;
     case SDL_EventType::SDL_CONTROLLERSENSORUPDATE:
-        if (event->csensor.sensor == SDL_SensorType::SDL_SENSOR_ACCEL) {
-            // Convert acceleration to g's.
-            float x = event->csensor.data[0] / SDL_STANDARD_GRAVITY;
-            float y = event->csensor.data[1] / SDL_STANDARD_GRAVITY;
-            float z = event->csensor.data[2] / SDL_STANDARD_GRAVITY;
-            ControllerState& state = InputState.controller_states[event->csensor.which];
-            state.latest_accelerometer[0] = x;
-            state.latest_accelerometer[1] = y;
-            state.latest_accelerometer[2] = z;
-        }
-        else if (event->csensor.sensor == SDL_SensorType::SDL_SENSOR_GYRO) {
-            // constexpr float gyro_threshold = 0.05f;
-            // Convert rotational velocity to degrees per second.
-            constexpr float rad_to_deg = 180.0f / M_PI;
-            float x = event->csensor.data[0] * rad_to_deg;
-            float y = event->csensor.data[1] * rad_to_deg;
-            float z = event->csensor.data[2] * rad_to_deg;
-            ControllerState& state = InputState.controller_states[event->csensor.which];
-            uint64_t cur_timestamp = event->csensor.timestamp;
-            uint32_t delta_ms = cur_timestamp - state.prev_gyro_timestamp;
-            state.motion.ProcessMotion(x, y, z, state.latest_accelerometer[0], state.latest_accelerometer[1], state.latest_accelerometer[2], delta_ms * 0.001f);
-            state.prev_gyro_timestamp = cur_timestamp;
-
-            float rot_x = 0.0f;
-            float rot_y = 0.0f;
-            state.motion.GetPlayerSpaceGyro(rot_x, rot_y);
-
-            {
-                std::lock_guard lock{ InputState.pending_input_mutex };
-                InputState.pending_rotation_delta[0] += rot_x;
-                InputState.pending_rotation_delta[1] += rot_y;
-            }
+        if (event->csensor.sensor == SDL_SensorType::SDL_SENSOR_ACCEL || event->csensor.sensor == SDL_SensorType::SDL_SENSOR_GYRO) {
+            // Sensor fusion runs on the game thread when it polls, which keeps it out of event handling.
+            SensorSample sample{
+                .which = event->csensor.which,
+                .sensor = static_cast<SDL_SensorType>(event->csensor.sensor),
+                .timestamp = event->csensor.timestamp,
+                .data = { event->csensor.data[0], event->csensor.data[1], event->csensor.data[2] },
+            };
+            InputState.sensor_samples.write(&sample, 1);
         }
         break;
     case SDL_EventType::SDL_MOUSEMOTION:
         if (!recomp::game_input_disabled()) {
             SDL_MouseMotionEvent* motion_event = &event->motion;
-            std::lock_guard lock{ InputState.pending_input_mutex };
-            InputState.pending_mouse_delta[0] += motion_event->xrel;
-            InputState.pending_mouse_delta[1] += motion_event->yrel;
+            InputState.pending_mouse_delta.add(float(motion_event->xrel), float(motion_event->yrel));
         }
         queue_if_enabled(event);
         break;
@@ -289,7 +632,7 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
         break;
     case SDL_EventType::SDL_CONTROLLERBUTTONUP:
         // Always queue button up events to avoid missing them during binding.
-        recompui::queue_event(*event);
+        queue_ui_event(*event);
         break;
     default:
         queue_if_enabled(event);
@@ -302,9 +645,19 @@ void recomp::handle_events() {
     SDL_Event cur_event;
     static bool started = false;
     static bool exited = false;
+    static bool cursor_state_applied = false;
+    static bool applied_cursor_locked = false;
+    static bool applied_cursor_visible = false;
+    bool had_events = false;
     while (SDL_PollEvent(&cur_event) && !exited) {
         exited = sdl_event_filter(nullptr, &cur_event);
+        had_events = true;
+    }
 
+    // Send any motion events that are still being merged, as nothing else will arrive this frame to flush them.
+    flush_ui_motion_events();
+
+    if (had_events) {
         // Lock the cursor if all three conditions are true: mouse aiming is enabled, game input is not disabled, and the game has been started. 
         bool cursor_locked = (recomp::get_mouse_sensitivity() != 0) && !recomp::game_input_disabled() && ultramodern::is_game_started();
 
@@ -314,8 +667,16 @@ void recomp::handle_events() {
             cursor_visible = false;
         }
 
-        SDL_ShowCursor(cursor_visible ? SDL_ENABLE : SDL_DISABLE);
-        SDL_SetRelativeMouseMode(cursor_locked ? SDL_TRUE : SDL_FALSE);
+        // Only call into SDL when the state changes.
+        if (!cursor_state_applied || cursor_visible != applied_cursor_visible) {
+            SDL_ShowCursor(cursor_visible ? SDL_ENABLE : SDL_DISABLE);
+            applied_cursor_visible = cursor_visible;
+        }
+        if (!cursor_state_applied || cursor_locked != applied_cursor_locked) {
+            SDL_SetRelativeMouseMode(cursor_locked ? SDL_TRUE : SDL_FALSE);
+            applied_cursor_locked = cursor_locked;
+        }
+        cursor_state_applied = true;
     }
 
     if (!started && ultramodern::is_game_started()) {
@@ -466,33 +827,109 @@ const recomp::DefaultN64Mappings recomp::default_n64_controller_mappings = {
     }
 };
 
-void recomp::poll_inputs() {
+// Takes a new input snapshot. Only called from the game thread, so the next snapshot can be filled in without
+// synchronization.
+static void take_input_snapshot() {
     InputState.keys = SDL_GetKeyboardState(&InputState.numkeys);
     InputState.keymod = SDL_GetModState();
 
-    {
-        std::lock_guard lock{ InputState.cur_controllers_mutex };
-        InputState.cur_controllers.clear();
+    // Taken before reading the controllers, so a change the pump thread sees while they're being read is left for
+    // the next snapshot rather than being dropped.
+    uint64_t controller_change_us = zelda64::input::take_controller_change();
 
-        for (const auto& [id, state] : InputState.controller_states) {
-            (void)id; // Avoid unused variable warning.
-            SDL_GameController* controller = state.controller;
-            if (controller != nullptr) {
-                InputState.cur_controllers.push_back(controller);
-            }
+    uint64_t next_generation = InputSnapshots.generation.load(std::memory_order_relaxed) + 1;
+    InputSnapshot& snapshot = InputSnapshots.snapshots[next_generation % input_snapshot_count];
+    const InputSnapshot& prev_snapshot = InputSnapshots.snapshots[(next_generation - 1) % input_snapshot_count];
+
+    snapshot.keys.fill(0);
+    if (InputState.keys) {
+        std::copy_n(InputState.keys, std::min<int>(InputState.numkeys, SDL_NUM_SCANCODES), snapshot.keys.begin());
+    }
+    snapshot.keymod = InputState.keymod;
+    for (PortSnapshot& port : snapshot.ports) {
+        port.buttons.fill(false);
+        port.axis_positive.fill(0.0f);
+        port.axis_negative.fill(0.0f);
+    }
+    snapshot.connected_ports = 1u << recomp::keyboard_n64_port;
+
+    for (const auto& [controller, port_index] : InputState.snapshot_controllers.update(InputState.controllers)) {
+        PortSnapshot& port = snapshot.ports[port_index];
+        for (int button = 0; button < SDL_CONTROLLER_BUTTON_MAX; button++) {
+            port.buttons[button] = port.buttons[button] || SDL_GameControllerGetButton(controller, (SDL_GameControllerButton)button);
+        }
+        for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++) {
+            float cur_val = SDL_GameControllerGetAxis(controller, (SDL_GameControllerAxis)axis) * (1/32768.0f);
+            port.axis_positive[axis] += std::clamp(cur_val, 0.0f, 1.0f);
+            port.axis_negative[axis] += std::clamp(-cur_val, 0.0f, 1.0f);
         }
+        snapshot.connected_ports |= 1u << port_index;
     }
 
-    // Read the deltas while resetting them to zero.
+    // The controller state can change before the gfx thread dispatches the event for it while the pump thread runs,
+    // so the change is traced from here instead. Hotplugs aren't inputs, so snapshots with different ports connected
+    // aren't compared. Only the game thread writes snapshots, so the previous one is stable.
+    if (InputSampling.pump_running.load(std::memory_order_relaxed) &&
+        snapshot.connected_ports == prev_snapshot.connected_ports && snapshot.ports != prev_snapshot.ports)
     {
-        std::lock_guard lock{ InputState.pending_input_mutex };
-        
-        InputState.rotation_delta = InputState.pending_rotation_delta;
-        InputState.pending_rotation_delta = { 0.0f, 0.0f };
+        zelda64::input::record_controller_event(controller_change_us);
+    }
 
-        InputState.mouse_delta = InputState.pending_mouse_delta;
-        InputState.pending_mouse_delta = { 0.0f, 0.0f };
+    InputSnapshots.generation.store(next_generation, std::memory_order_release);
+    zelda64::input::record_poll();
+}
+
+// Runs sensor fusion on the motion samples received since the last poll and returns the summed rotation.
+static std::array<float, 2> process_sensor_samples() {
+    std::array<float, 2> rotation_delta{};
+    std::array<SensorSample, 64> samples;
+    size_t sample_count;
+
+    while ((sample_count = InputState.sensor_samples.read(samples.data(), samples.size())) != 0) {
+        for (size_t i = 0; i < sample_count; i++) {
+            const SensorSample& sample = samples[i];
+            if (sample.sensor == SDL_SensorType::SDL_SENSOR_INVALID) {
+                InputState.motion_states.erase(sample.which);
+            }
+            else if (sample.sensor == SDL_SensorType::SDL_SENSOR_ACCEL) {
+                // Convert acceleration to g's.
+                MotionState& state = InputState.motion_states[sample.which];
+                state.latest_accelerometer[0] = sample.data[0] / SDL_STANDARD_GRAVITY;
+                state.latest_accelerometer[1] = sample.data[1] / SDL_STANDARD_GRAVITY;
+                state.latest_accelerometer[2] = sample.data[2] / SDL_STANDARD_GRAVITY;
+            }
+            else if (sample.sensor == SDL_SensorType::SDL_SENSOR_GYRO) {
+                // constexpr float gyro_threshold = 0.05f;
+                // Convert rotational velocity to degrees per second.
+                constexpr float rad_to_deg = 180.0f / M_PI;
+                float x = sample.data[0] * rad_to_deg;
+                float y = sample.data[1] * rad_to_deg;
+                float z = sample.data[2] * rad_to_deg;
+                MotionState& state = InputState.motion_states[sample.which];
+                uint32_t delta_ms = sample.timestamp - state.prev_gyro_timestamp;
+                state.motion.ProcessMotion(x, y, z, state.latest_accelerometer[0], state.latest_accelerometer[1], state.latest_accelerometer[2], delta_ms * 0.001f);
+                state.prev_gyro_timestamp = sample.timestamp;
+
+                float rot_x = 0.0f;
+                float rot_y = 0.0f;
+                state.motion.GetPlayerSpaceGyro(rot_x, rot_y);
+                rotation_delta[0] += rot_x;
+                rotation_delta[1] += rot_y;
+            }
+        }
     }
+
+    return rotation_delta;
+}
+
+void recomp::poll_inputs() {
+    zelda64::input::advance_movie_poll();
+
+    take_input_snapshot();
+
+    // Read the deltas while resetting them to zero.
+    InputState.rotation_delta = process_sensor_samples();
+    InputState.mouse_delta = InputState.pending_mouse_delta.take();
     
     // Quicksaving is disabled for now and will likely have more limited functionality
     // when restored, rather than allowing saving and loading at any point in time.
@@ -513,19 +950,115 @@ void recomp::poll_inputs() {
     #endif
 }
 
+// Controller state as seen by the pump thread, for timestamping changes for the input latency stats.
+struct PumpControllerState {
+    uint32_t buttons;
+    std::array<Sint16, SDL_CONTROLLER_AXIS_MAX> axes;
+
+    bool operator==(const PumpControllerState& rhs) const = default;
+};
+
+static PumpControllerState read_pump_controller_state(SDL_GameController* controller) {
+    PumpControllerState ret{};
+    for (int button = 0; button < SDL_CONTROLLER_BUTTON_MAX; button++) {
+        if (SDL_GameControllerGetButton(controller, (SDL_GameControllerButton)button)) {
+            ret.buttons |= 1u << button;
+        }
+    }
+    for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++) {
+        ret.axes[axis] = SDL_GameControllerGetAxis(controller, (SDL_GameControllerAxis)axis);
+    }
+    return ret;
+}
+
+static void input_pump_thread(int rate_hz) {
+    auto interval = std::chrono::nanoseconds(1000000000 / rate_hz);
+    auto next_update = std::chrono::steady_clock::now();
+    CachedControllerList controllers;
+    uint64_t states_epoch = UINT64_MAX;
+    std::vector<PumpControllerState> states;
+
+    while (InputSampling.pump_running.load(std::memory_order_acquire)) {
+        // Refreshes the state that SDL_GameControllerGetButton and SDL_GameControllerGetAxis return. This takes SDL's
+        // joystick lock, so it's safe alongside the event pumping on the gfx thread. Any events it generates are
+        // still handled on the gfx thread.
+        SDL_GameControllerUpdate();
+
+        // The snapshots can pick up the new state before those events are handled, so note the time of the change
+        // here for the latency stats. The states are reset on hotplug, as a controller appearing isn't an input.
+        const ControllerList& cur_controllers = controllers.update(InputState.controllers);
+        bool reset_states = controllers.epoch != states_epoch;
+        states.resize(cur_controllers.size());
+        states_epoch = controllers.epoch;
+        for (size_t i = 0; i < cur_controllers.size(); i++) {
+            PumpControllerState cur_state = read_pump_controller_state(cur_controllers[i].first);
+            if (!reset_states && cur_state != states[i]) {
+                zelda64::input::record_controller_change();
+            }
+            states[i] = cur_state;
+        }
+
+        next_update += interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next_update < now) {
+            // Fell behind, don't try to catch up on the missed updates.
+            next_update = now;
+        }
+        std::this_thread::sleep_until(next_update);
+    }
+}
+
+void recomp::start_just_in_time_input(int pump_rate_hz) {
+    if (InputSampling.just_in_time.exchange(true)) {
+        return;
+    }
+
+    if (pump_rate_hz > 0) {
+        InputSampling.pump_running.store(true, std::memory_order_release);
+        InputSampling.pump_thread = std::thread{input_pump_thread, pump_rate_hz};
+    }
+}
+
+void recomp::stop_just_in_time_input() {
+    if (!InputSampling.just_in_time.exchange(false)) {
+        return;
+    }
+
+    if (InputSampling.pump_running.exchange(false)) {
+        InputSampling.pump_thread.join();
+    }
+}
+
+void recomp::sample_inputs_for_read() {
+    if (InputSampling.just_in_time.load(std::memory_order_relaxed)) {
+        take_input_snapshot();
+    }
+}
+
 void recomp::set_rumble(int controller_num, bool on) {
-    if (controller_num == 0) {
-        InputState.rumble_active = on;
+    if (controller_num >= 0 && controller_num < recomp::num_n64_ports) {
+        InputState.rumble_active[controller_num] = on;
     }
 }
 
 ultramodern::input::connected_device_info_t recomp::get_connected_device_info(int controller_num) {
-    switch (controller_num) {
-        case 0:
-            return ultramodern::input::connected_device_info_t {
-                .connected_device = ultramodern::input::Device::Controller,
-                .connected_pak = ultramodern::input::Pak::RumblePak,
-            };
+    bool connected;
+    if (zelda64::input::movie_playing()) {
+        // Report the ports the movie was recorded with so the game sets up the same controllers.
+        connected = zelda64::input::movie_port_used(controller_num);
+    }
+    else {
+        connected = controller_num >= 0 && controller_num < recomp::num_n64_ports &&
+            read_input_snapshot([&](const InputSnapshot& snapshot) {
+                return (snapshot.connected_ports & (1u << controller_num)) != 0;
+            });
+    }
+
+    if (connected) {
+        return ultramodern::input::connected_device_info_t {
+            .connected_device = ultramodern::input::Device::Controller,
+            .connected_pak = ultramodern::input::Pak::RumblePak,
+        };
     }
 
     return ultramodern::input::connected_device_info_t {
@@ -539,40 +1072,132 @@ static float smoothstep(float from, float to, float amount) {
     return std::lerp(from, to, amount);
 }
 
+// Rumble is sent to the controllers by a separate thread, as with HIDAPI drivers every SDL_GameControllerRumble call
+// can be a USB or Bluetooth write. The VI callback only computes each port's strength, and the thread sends it to a
+// controller when it changes or when the previous rumble is close to expiring.
+constexpr uint32_t rumble_duration_ms = 2000;
+constexpr auto rumble_refresh_margin = std::chrono::milliseconds(500);
+
+static struct {
+    std::array<std::atomic<uint16_t>, recomp::num_n64_ports> port_strengths{};
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool update_pending = false;
+    bool running = false;
+    std::thread thread;
+} Haptics;
+
+struct SubmittedRumble {
+    // Strength last sent to the controller, or -1 if nothing has been sent yet.
+    int32_t strength;
+    std::chrono::steady_clock::time_point expiry;
+};
+
+static void haptics_thread() {
+    CachedControllerList controllers;
+    std::vector<SubmittedRumble> submitted;
+    uint64_t submitted_epoch = UINT64_MAX;
+
+    while (true) {
+        {
+            std::unique_lock lock{ Haptics.mutex };
+            Haptics.cv.wait_for(lock, rumble_refresh_margin, [] { return Haptics.update_pending || !Haptics.running; });
+            if (!Haptics.running) {
+                break;
+            }
+            Haptics.update_pending = false;
+        }
+
+        const ControllerList& cur_controllers = controllers.update(InputState.controllers);
+        if (controllers.epoch != submitted_epoch) {
+            // Resend to every controller after a hotplug.
+            submitted.assign(cur_controllers.size(), SubmittedRumble{ -1, {} });
+            submitted_epoch = controllers.epoch;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < cur_controllers.size(); i++) {
+            const auto& [controller, port] = cur_controllers[i];
+            SubmittedRumble& cur_submitted = submitted[i];
+            uint16_t strength = Haptics.port_strengths[port].load(std::memory_order_relaxed);
+
+            bool changed = int32_t(strength) != cur_submitted.strength;
+            // A stopped rumble doesn't need to be kept alive.
+            bool expiring = strength != 0 && now + rumble_refresh_margin >= cur_submitted.expiry;
+            if (changed || expiring) {
+                SDL_GameControllerRumble(controller, 0, strength, rumble_duration_ms);
+                cur_submitted.strength = strength;
+                cur_submitted.expiry = now + std::chrono::milliseconds(rumble_duration_ms);
+            }
+        }
+    }
+
+    // Stop any rumble that's still going.
+    for (const auto& [controller, port] : controllers.update(InputState.controllers)) {
+        (void)port; // Avoid unused variable warning.
+        SDL_GameControllerRumble(controller, 0, 0, 0);
+    }
+}
+
+void recomp::start_haptics() {
+    std::lock_guard lock{ Haptics.mutex };
+    if (!Haptics.running) {
+        Haptics.running = true;
+        Haptics.thread = std::thread{haptics_thread};
+    }
+}
+
+void recomp::stop_haptics() {
+    {
+        std::lock_guard lock{ Haptics.mutex };
+        if (!Haptics.running) {
+            return;
+        }
+        Haptics.running = false;
+    }
+    Haptics.cv.notify_one();
+    Haptics.thread.join();
+}
+
 // Update rumble to attempt to mimic the way n64 rumble ramps up and falls off
 void recomp::update_rumble() {
-    // Note: values are not accurate! just approximations based on feel
-    if (InputState.rumble_active) {
-        InputState.cur_rumble += 0.17f;
-        if (InputState.cur_rumble > 1) InputState.cur_rumble = 1;
-    } else {
-        InputState.cur_rumble *= 0.92f;
-        InputState.cur_rumble -= 0.01f;
-        if (InputState.cur_rumble < 0) InputState.cur_rumble = 0;
-    }
-    float smooth_rumble = smoothstep(0, 1, InputState.cur_rumble);
-
-    uint16_t rumble_strength = smooth_rumble * (recomp::get_rumble_strength() * 0xFFFF / 100);
-    uint32_t duration = 1000000; // Dummy duration value that lasts long enough to matter as the game will reset rumble on its own.
-    {
-        std::lock_guard lock{ InputState.cur_controllers_mutex };
-        for (const auto& controller : InputState.cur_controllers) {
-            SDL_GameControllerRumble(controller, 0, rumble_strength, duration);
+    for (int port = 0; port < recomp::num_n64_ports; port++) {
+        float& cur_rumble = InputState.cur_rumble[port];
+        // Note: values are not accurate! just approximations based on feel
+        if (InputState.rumble_active[port]) {
+            cur_rumble += 0.17f;
+            if (cur_rumble > 1) cur_rumble = 1;
+        } else {
+            cur_rumble *= 0.92f;
+            cur_rumble -= 0.01f;
+            if (cur_rumble < 0) cur_rumble = 0;
         }
+        float smooth_rumble = smoothstep(0, 1, cur_rumble);
+
+        // Quantize to 8 bits, which is the most that controllers take, so that strengths that would reach the
+        // controller as the same value don't count as a change.
+        uint16_t strength = uint16_t(smooth_rumble * (recomp::get_rumble_strength() * 0xFFFF / 100));
+        Haptics.port_strengths[port].store(uint16_t((strength >> 8) * 0x101), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard lock{ Haptics.mutex };
+        Haptics.update_pending = true;
     }
+    Haptics.cv.notify_one();
 }
 
-bool controller_button_state(int32_t input_id) {
+// A port of -1 reads the controllers on every port.
+static bool controller_button_state(const InputSnapshot& snapshot, int port, int32_t input_id) {
     if (input_id >= 0 && input_id < SDL_GameControllerButton::SDL_CONTROLLER_BUTTON_MAX) {
-        SDL_GameControllerButton button = (SDL_GameControllerButton)input_id;
-        bool ret = false;
-        {
-            std::lock_guard lock{ InputState.cur_controllers_mutex };
-            for (const auto& controller : InputState.cur_controllers) {
-                ret |= SDL_GameControllerGetButton(controller, button);
-            }
+        if (port >= 0) {
+            return snapshot.ports[port].buttons[input_id];
         }
 
+        bool ret = false;
+        for (const PortSnapshot& cur_port : snapshot.ports) {
+            ret |= cur_port.buttons[input_id];
+        }
         return ret;
     }
     return false;
@@ -580,93 +1205,190 @@ bool controller_button_state(int32_t input_id) {
 
 static std::atomic_bool right_analog_suppressed = false;
 
-float controller_axis_state(int32_t input_id, bool allow_suppression) {
-    if (abs(input_id) - 1 < SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_MAX) {
+static float controller_axis_state(const InputSnapshot& snapshot, int port, int32_t input_id, bool allow_suppression) {
+    if (input_id != 0 && abs(input_id) - 1 < SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_MAX) {
         SDL_GameControllerAxis axis = (SDL_GameControllerAxis)(abs(input_id) - 1);
         bool negative_range = input_id < 0;
-        float ret = 0.0f;
 
-        {
-            std::lock_guard lock{ InputState.cur_controllers_mutex };
-            for (const auto& controller : InputState.cur_controllers) {
-                float cur_val = SDL_GameControllerGetAxis(controller, axis) * (1/32768.0f);
-                if (negative_range) {
-                    cur_val = -cur_val;
-                }
+        // Check if this input is a right analog axis and suppress it accordingly.
+        if (allow_suppression && right_analog_suppressed.load() &&
+            (axis == SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX || axis == SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY)) {
+            return 0.0f;
+        }
 
-                // Check if this input is a right analog axis and suppress it accordingly.
-                if (allow_suppression && right_analog_suppressed.load() &&
-                    (axis == SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX || axis == SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY)) {
-                    cur_val = 0;
-                }
-                ret += std::clamp(cur_val, 0.0f, 1.0f);
+        float ret = 0.0f;
+        for (int cur_port = 0; cur_port < recomp::num_n64_ports; cur_port++) {
+            if (port < 0 || port == cur_port) {
+                const PortSnapshot& port_snapshot = snapshot.ports[cur_port];
+                ret += negative_range ? port_snapshot.axis_negative[axis] : port_snapshot.axis_positive[axis];
             }
         }
-
         return std::clamp(ret, 0.0f, 1.0f);
     }
     return false;
 }
 
-float recomp::get_input_analog(const recomp::InputField& field) {
+static bool keyboard_key_state(const InputSnapshot& snapshot, int port, int32_t input_id) {
+    if (port >= 0 && port != recomp::keyboard_n64_port) {
+        return false;
+    }
+    if (input_id >= 0 && input_id < SDL_NUM_SCANCODES) {
+        if (should_override_keystate(static_cast<SDL_Scancode>(input_id), snapshot.keymod)) {
+            return false;
+        }
+        return snapshot.keys[input_id] != 0;
+    }
+    return false;
+}
+
+static float get_input_analog(const InputSnapshot& snapshot, int port, const recomp::InputField& field) {
     switch ((InputType)field.input_type) {
     case InputType::Keyboard:
-        if (InputState.keys && field.input_id >= 0 && field.input_id < InputState.numkeys) {
-            if (should_override_keystate(static_cast<SDL_Scancode>(field.input_id), InputState.keymod)) {
-                return 0.0f;
-            }
-            return InputState.keys[field.input_id] ? 1.0f : 0.0f;
-        }
-        return 0.0f;
+        return keyboard_key_state(snapshot, port, field.input_id) ? 1.0f : 0.0f;
     case InputType::ControllerDigital:
-        return controller_button_state(field.input_id) ? 1.0f : 0.0f;
+        return controller_button_state(snapshot, port, field.input_id) ? 1.0f : 0.0f;
     case InputType::ControllerAnalog:
-        return controller_axis_state(field.input_id, true);
+        return controller_axis_state(snapshot, port, field.input_id, true);
     case InputType::Mouse:
         // TODO mouse support
         return 0.0f;
     case InputType::None:
         return false;
     }
+    return 0.0f;
 }
 
-float recomp::get_input_analog(const std::span<const recomp::InputField> fields) {
-    float ret = 0.0f;
-    for (const auto& field : fields) {
-        ret += get_input_analog(field);
-    }
-    return std::clamp(ret, 0.0f, 1.0f);
-}
-
-bool recomp::get_input_digital(const recomp::InputField& field) {
+static bool get_input_digital(const InputSnapshot& snapshot, int port, const recomp::InputField& field) {
     switch ((InputType)field.input_type) {
     case InputType::Keyboard:
-        if (InputState.keys && field.input_id >= 0 && field.input_id < InputState.numkeys) {
-            if (should_override_keystate(static_cast<SDL_Scancode>(field.input_id), InputState.keymod)) {
-                return false;
-            }
-            return InputState.keys[field.input_id] != 0;
-        }
-        return false;
+        return keyboard_key_state(snapshot, port, field.input_id);
     case InputType::ControllerDigital:
-        return controller_button_state(field.input_id);
+        return controller_button_state(snapshot, port, field.input_id);
     case InputType::ControllerAnalog:
         // TODO adjustable threshold
-        return controller_axis_state(field.input_id, true) >= axis_threshold;
+        return controller_axis_state(snapshot, port, field.input_id, true) >= axis_threshold;
     case InputType::Mouse:
         // TODO mouse support
         return false;
     case InputType::None:
         return false;
     }
+    return false;
+}
+
+float recomp::get_input_analog(const recomp::InputField& field) {
+    return read_input_snapshot([&](const InputSnapshot& snapshot) {
+        return ::get_input_analog(snapshot, -1, field);
+    });
+}
+
+float recomp::get_input_analog(const std::span<const recomp::InputField> fields) {
+    return recomp::get_input_analog(-1, fields);
+}
+
+float recomp::get_input_analog(int port, const std::span<const recomp::InputField> fields) {
+    return read_input_snapshot([&](const InputSnapshot& snapshot) {
+        float ret = 0.0f;
+        for (const auto& field : fields) {
+            ret += ::get_input_analog(snapshot, port, field);
+        }
+        return std::clamp(ret, 0.0f, 1.0f);
+    });
+}
+
+bool recomp::get_input_digital(const recomp::InputField& field) {
+    return read_input_snapshot([&](const InputSnapshot& snapshot) {
+        return ::get_input_digital(snapshot, -1, field);
+    });
 }
 
 bool recomp::get_input_digital(const std::span<const recomp::InputField> fields) {
-    bool ret = 0;
-    for (const auto& field : fields) {
-        ret |= get_input_digital(field);
+    return recomp::get_input_digital(-1, fields);
+}
+
+bool recomp::get_input_digital(int port, const std::span<const recomp::InputField> fields) {
+    return read_input_snapshot([&](const InputSnapshot& snapshot) {
+        bool ret = false;
+        for (const auto& field : fields) {
+            ret |= ::get_input_digital(snapshot, port, field);
+        }
+        return ret;
+    });
+}
+
+void recomp::add_compiled_binding(recomp::CompiledBindingList& list, const recomp::InputField& field, uint16_t buttons, uint8_t axes) {
+    CompiledBinding* entries;
+    size_t* count;
+    switch ((InputType)field.input_type) {
+    case InputType::Keyboard:
+        entries = list.keys.data();
+        count = &list.num_keys;
+        break;
+    case InputType::ControllerDigital:
+        entries = list.controller_buttons.data();
+        count = &list.num_controller_buttons;
+        break;
+    case InputType::ControllerAnalog:
+        entries = list.controller_axes.data();
+        count = &list.num_controller_axes;
+        break;
+    default:
+        // Unbound or unsupported input.
+        return;
     }
-    return ret;
+
+    // Merge with the existing entry if this input is already bound to something else.
+    for (size_t i = 0; i < *count; i++) {
+        if (entries[i].input_id == field.input_id) {
+            entries[i].buttons |= buttons;
+            entries[i].axes |= axes;
+            return;
+        }
+    }
+
+    if (*count < CompiledBindingList::max_entries) {
+        entries[(*count)++] = { field.input_id, buttons, axes };
+    }
+}
+
+static void accumulate_compiled_binding(const recomp::CompiledBinding& binding, float value, bool held, recomp::N64InputState& state) {
+    state.buttons |= held ? binding.buttons : 0;
+    for (size_t axis = 0; axis < state.axes.size(); axis++) {
+        state.axes[axis] += ((binding.axes >> axis) & 1) ? value : 0.0f;
+    }
+}
+
+void recomp::evaluate_compiled_bindings(int port, const recomp::CompiledBindings& bindings,
+    std::array<recomp::N64InputState, static_cast<size_t>(recomp::InputDevice::COUNT)>& states_out)
+{
+    states_out = read_input_snapshot([&](const InputSnapshot& snapshot) {
+        std::array<recomp::N64InputState, static_cast<size_t>(recomp::InputDevice::COUNT)> states{};
+
+        for (size_t device = 0; device < bindings.devices.size(); device++) {
+            const CompiledBindingList& list = bindings.devices[device];
+            N64InputState& state = states[device];
+
+            for (size_t i = 0; i < list.num_keys; i++) {
+                bool held = keyboard_key_state(snapshot, port, list.keys[i].input_id);
+                accumulate_compiled_binding(list.keys[i], held ? 1.0f : 0.0f, held, state);
+            }
+            for (size_t i = 0; i < list.num_controller_buttons; i++) {
+                bool held = controller_button_state(snapshot, port, list.controller_buttons[i].input_id);
+                accumulate_compiled_binding(list.controller_buttons[i], held ? 1.0f : 0.0f, held, state);
+            }
+            for (size_t i = 0; i < list.num_controller_axes; i++) {
+                float value = controller_axis_state(snapshot, port, list.controller_axes[i].input_id, true);
+                // TODO adjustable threshold
+                accumulate_compiled_binding(list.controller_axes[i], value, value >= axis_threshold, state);
+            }
+
+            for (float& axis : state.axes) {
+                axis = std::clamp(axis, 0.0f, 1.0f);
+            }
+        }
+
+        return states;
+    });
 }
 
 void recomp::get_gyro_deltas(float* x, float* y) {
@@ -719,12 +1441,14 @@ void recomp::apply_joystick_deadzone(float x_in, float y_in, float* x_out, float
 }
 
 void recomp::get_right_analog(float* x, float* y) {
-    float x_val =
-        controller_axis_state((SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX + 1), false) -
-        controller_axis_state(-(SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX + 1), false);
-    float y_val =
-        controller_axis_state((SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY + 1), false) -
-        controller_axis_state(-(SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY + 1), false);
+    auto [x_val, y_val] = read_input_snapshot([](const InputSnapshot& snapshot) {
+        return std::pair{
+            controller_axis_state(snapshot, -1, (SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX + 1), false) -
+            controller_axis_state(snapshot, -1, -(SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTX + 1), false),
+            controller_axis_state(snapshot, -1, (SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY + 1), false) -
+            controller_axis_state(snapshot, -1, -(SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_RIGHTY + 1), false)
+        };
+    });
     recomp::apply_joystick_deadzone(x_val, y_val, x, y);
 }
 
@@ -0,0 +1,153 @@
+#include <chrono>
+#include <cstdio>
+
+#include "zelda_input_latency.h"
+
+using zelda64::Histogram;
+using zelda64::stats_histogram_buckets;
+
+struct LatencyTrace {
+    std::atomic<uint64_t> events{};
+    std::atomic<uint64_t> coalesced_events{};
+    // Timestamps in microseconds of the event being traced at each stage, or zero if there isn't one.
+    std::atomic<uint64_t> pending_event_us{};
+    std::atomic<uint64_t> polled_event_us{};
+    std::atomic<uint64_t> read_event_us{};
+    // Timestamp in microseconds of the first controller change the pump thread saw since the last snapshot, or zero.
+    std::atomic<uint64_t> controller_change_us{};
+    Histogram event_to_poll_us;
+    Histogram event_to_read_us;
+    Histogram event_to_present_us;
+};
+
+static LatencyTrace latency_trace{};
+
+static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Moves the traced event out of one stage, records its latency and hands it to the next stage. The next stage keeps
+// its current event if it hasn't consumed it yet, since that one is older.
+static void advance_trace(std::atomic<uint64_t>& from, std::atomic<uint64_t>* to, Histogram& histogram) {
+    uint64_t event_us = from.exchange(0, std::memory_order_relaxed);
+    if (event_us == 0) {
+        return;
+    }
+
+    uint64_t cur_us = now_us();
+    histogram.record(cur_us > event_us ? cur_us - event_us : 0);
+
+    if (to != nullptr) {
+        uint64_t expected = 0;
+        to->compare_exchange_strong(expected, event_us, std::memory_order_relaxed);
+    }
+}
+
+static void start_trace(uint64_t event_us) {
+    latency_trace.events.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t expected = 0;
+    latency_trace.pending_event_us.compare_exchange_strong(expected, event_us, std::memory_order_relaxed);
+}
+
+void zelda64::input::record_event(uint64_t age_us) {
+    start_trace(now_us() - age_us);
+}
+
+void zelda64::input::record_controller_change() {
+    uint64_t expected = 0;
+    latency_trace.controller_change_us.compare_exchange_strong(expected, now_us(), std::memory_order_relaxed);
+}
+
+uint64_t zelda64::input::take_controller_change() {
+    return latency_trace.controller_change_us.exchange(0, std::memory_order_relaxed);
+}
+
+void zelda64::input::record_controller_event(uint64_t change_us) {
+    start_trace(change_us != 0 ? change_us : now_us());
+}
+
+void zelda64::input::record_poll() {
+    advance_trace(latency_trace.pending_event_us, &latency_trace.polled_event_us, latency_trace.event_to_poll_us);
+}
+
+void zelda64::input::record_read() {
+    advance_trace(latency_trace.polled_event_us, &latency_trace.read_event_us, latency_trace.event_to_read_us);
+}
+
+void zelda64::input::record_present() {
+    advance_trace(latency_trace.read_event_us, nullptr, latency_trace.event_to_present_us);
+}
+
+void zelda64::input::record_coalesced_event() {
+    latency_trace.coalesced_events.fetch_add(1, std::memory_order_relaxed);
+}
+
+zelda64::input::LatencyStats zelda64::input::get_latency_stats() {
+    LatencyStats ret{};
+    ret.events = latency_trace.events.load(std::memory_order_relaxed);
+    ret.coalesced_events = latency_trace.coalesced_events.load(std::memory_order_relaxed);
+    ret.event_to_poll_us = latency_trace.event_to_poll_us.snapshot();
+    ret.event_to_read_us = latency_trace.event_to_read_us.snapshot();
+    ret.event_to_present_us = latency_trace.event_to_present_us.snapshot();
+    return ret;
+}
+
+void zelda64::input::reset_latency_stats() {
+    latency_trace.events.store(0, std::memory_order_relaxed);
+    latency_trace.coalesced_events.store(0, std::memory_order_relaxed);
+    latency_trace.pending_event_us.store(0, std::memory_order_relaxed);
+    latency_trace.polled_event_us.store(0, std::memory_order_relaxed);
+    latency_trace.read_event_us.store(0, std::memory_order_relaxed);
+    latency_trace.controller_change_us.store(0, std::memory_order_relaxed);
+    latency_trace.event_to_poll_us.reset();
+    latency_trace.event_to_read_us.reset();
+    latency_trace.event_to_present_us.reset();
+}
+
+std::vector<std::string> zelda64::input::format_latency_stats(const LatencyStats& stats) {
+    char events_line[128];
+    snprintf(events_line, sizeof(events_line), "Input events: %llu", (unsigned long long)stats.events);
+    char coalesced_line[128];
+    snprintf(coalesced_line, sizeof(coalesced_line), "Motion events merged for the UI: %llu", (unsigned long long)stats.coalesced_events);
+    return {
+        events_line,
+        coalesced_line,
+        zelda64::format_histogram("Input to poll (us)", stats.event_to_poll_us),
+        zelda64::format_histogram("Input to game read (us)", stats.event_to_read_us),
+        zelda64::format_histogram("Input to present (us)", stats.event_to_present_us),
+    };
+}
+
+static void dump_histogram(FILE* file, const char* stage, const zelda64::HistogramSnapshot& histogram) {
+    for (size_t i = 0; i < stats_histogram_buckets; i++) {
+        if (histogram.buckets[i] == 0) {
+            continue;
+        }
+        fprintf(file, "%s,%llu,%llu,%llu\n", stage,
+            (unsigned long long)zelda64::HistogramSnapshot::bucket_low(i),
+            (unsigned long long)zelda64::HistogramSnapshot::bucket_high(i),
+            (unsigned long long)histogram.buckets[i]);
+    }
+}
+
+bool zelda64::input::dump_latency_stats(const std::filesystem::path& path) {
+    LatencyStats stats = get_latency_stats();
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    file = _wfopen(path.c_str(), L"w");
+#else
+    file = fopen(path.c_str(), "w");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "stage,min_us,max_us,count\n");
+    dump_histogram(file, "poll", stats.event_to_poll_us);
+    dump_histogram(file, "read", stats.event_to_read_us);
+    dump_histogram(file, "present", stats.event_to_present_us);
+
+    return fclose(file) == 0;
+}
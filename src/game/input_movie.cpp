@@ -0,0 +1,435 @@
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "recomp_input.h"
+#include "zelda_input_movie.h"
+#include "../main/capture_gate.h"
+#include "../main/spsc_ring_buffer.h"
+
+// File layout, all values little endian:
+//   Header: "DM64MOVI", u32 version, u32 mask of the ports that were connected at any point. The mask is filled in
+//   when the recording stops, so playback also derives it from the records in case the recording was cut off.
+//   Records, one for every poll where a port changed:
+//     LEB128 number of polls since the previous record (or since poll zero for the first one)
+//     u8 mask of the ports that changed
+//     For each changed port in ascending order:
+//       u8 mask of the fields that changed (movie_field_*), followed by the new value of each changed field in
+//       bit order: u8 connected, u16 buttons, f32 x, f32 y.
+constexpr char movie_magic[8] = { 'D', 'M', '6', '4', 'M', 'O', 'V', 'I' };
+constexpr uint32_t movie_version = 1;
+constexpr size_t movie_header_size = 16;
+
+constexpr uint8_t movie_field_connected = 1 << 0;
+constexpr uint8_t movie_field_buttons = 1 << 1;
+constexpr uint8_t movie_field_x = 1 << 2;
+constexpr uint8_t movie_field_y = 1 << 3;
+
+// Size of the queue between the game thread and the writer thread. A record is at most 62 bytes, so this holds
+// minutes of constantly changing input.
+constexpr size_t movie_queue_size = size_t{1} << 20;
+constexpr auto movie_write_interval = std::chrono::milliseconds(100);
+
+struct MoviePortState {
+    bool connected;
+    uint16_t buttons;
+    float x;
+    float y;
+};
+
+enum class MovieMode {
+    None,
+    Recording,
+    Playback
+};
+
+struct MovieState {
+    // Only changed while the gate is closed. The game thread uses the movie inside the gate, so stop_movie can flush
+    // and free it once the gate is closed.
+    std::atomic<MovieMode> mode = MovieMode::None;
+    zelda64::CaptureGate gate;
+    uint64_t poll_index = 0;
+    std::array<MoviePortState, recomp::num_n64_ports> ports{};
+    uint32_t ports_used = 0;
+
+    // Recording
+    FILE* file = nullptr;
+    std::unique_ptr<zelda64::SpscRingBuffer<uint8_t>> queue;
+    std::array<MoviePortState, recomp::num_n64_ports> written_ports{};
+    uint64_t last_record_poll = 0;
+    bool overflowed = false;
+    std::atomic<bool> stop_requested = false;
+    std::thread writer_thread;
+
+    // Playback
+    std::vector<uint8_t> data;
+    size_t read_pos = 0;
+    uint64_t next_record_poll = 0;
+    bool has_next_record = false;
+};
+
+static MovieState movie_state{};
+
+static void write_u32(uint8_t* out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+static uint32_t read_u32(const uint8_t* in) {
+    return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+}
+
+static void write_movie_header(FILE* file, uint32_t ports_used) {
+    uint8_t header[movie_header_size];
+    memcpy(header, movie_magic, sizeof(movie_magic));
+    write_u32(header + 8, movie_version);
+    write_u32(header + 12, ports_used);
+    fwrite(header, 1, sizeof(header), file);
+}
+
+static void drain_movie_queue(std::vector<uint8_t>& chunk) {
+    size_t read_count;
+    while ((read_count = movie_state.queue->read(chunk.data(), chunk.size())) != 0) {
+        fwrite(chunk.data(), 1, read_count, movie_state.file);
+    }
+}
+
+static void movie_writer_thread() {
+    std::vector<uint8_t> chunk(size_t{1} << 16);
+
+    while (!movie_state.stop_requested.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(movie_write_interval);
+        drain_movie_queue(chunk);
+    }
+
+    drain_movie_queue(chunk);
+}
+
+// Encodes the changes made during the current poll and queues them for the writer thread.
+static void flush_movie_record() {
+    uint8_t record[64];
+    size_t size = 0;
+
+    uint8_t port_mask = 0;
+    std::array<uint8_t, recomp::num_n64_ports> field_masks{};
+    for (int port = 0; port < recomp::num_n64_ports; port++) {
+        const MoviePortState& cur = movie_state.ports[port];
+        const MoviePortState& prev = movie_state.written_ports[port];
+        uint8_t fields = 0;
+        fields |= cur.connected != prev.connected ? movie_field_connected : 0;
+        fields |= cur.buttons != prev.buttons ? movie_field_buttons : 0;
+        fields |= std::bit_cast<uint32_t>(cur.x) != std::bit_cast<uint32_t>(prev.x) ? movie_field_x : 0;
+        fields |= std::bit_cast<uint32_t>(cur.y) != std::bit_cast<uint32_t>(prev.y) ? movie_field_y : 0;
+        field_masks[port] = fields;
+        port_mask |= fields != 0 ? (1 << port) : 0;
+    }
+
+    if (port_mask == 0 || movie_state.overflowed) {
+        return;
+    }
+
+    uint64_t poll_delta = movie_state.poll_index - movie_state.last_record_poll;
+    do {
+        uint8_t byte = poll_delta & 0x7F;
+        poll_delta >>= 7;
+        record[size++] = byte | (poll_delta != 0 ? 0x80 : 0);
+    } while (poll_delta != 0);
+
+    record[size++] = port_mask;
+    for (int port = 0; port < recomp::num_n64_ports; port++) {
+        uint8_t fields = field_masks[port];
+        if (fields == 0) {
+            continue;
+        }
+        const MoviePortState& cur = movie_state.ports[port];
+        record[size++] = fields;
+        if (fields & movie_field_connected) {
+            record[size++] = cur.connected ? 1 : 0;
+        }
+        if (fields & movie_field_buttons) {
+            record[size++] = uint8_t(cur.buttons);
+            record[size++] = uint8_t(cur.buttons >> 8);
+        }
+        if (fields & movie_field_x) {
+            write_u32(record + size, std::bit_cast<uint32_t>(cur.x));
+            size += 4;
+        }
+        if (fields & movie_field_y) {
+            write_u32(record + size, std::bit_cast<uint32_t>(cur.y));
+            size += 4;
+        }
+    }
+
+    // A partial record would corrupt the rest of the movie, so stop recording if the writer falls this far behind.
+    if (movie_state.queue->get_capacity() - movie_state.queue->size() < size) {
+        movie_state.overflowed = true;
+        fprintf(stderr, "Input movie recording stopped at poll %llu because the writer couldn't keep up\n",
+            (unsigned long long)movie_state.poll_index);
+        return;
+    }
+
+    movie_state.queue->write(record, size);
+    movie_state.written_ports = movie_state.ports;
+    movie_state.last_record_poll = movie_state.poll_index;
+}
+
+// Reads the poll index of the next record, leaving the read position at its port mask.
+static void read_next_record_poll() {
+    uint64_t poll_delta = 0;
+    uint32_t shift = 0;
+    while (movie_state.read_pos < movie_state.data.size() && shift < 64) {
+        uint8_t byte = movie_state.data[movie_state.read_pos++];
+        poll_delta |= uint64_t(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            movie_state.next_record_poll += poll_delta;
+            movie_state.has_next_record = true;
+            return;
+        }
+    }
+    movie_state.has_next_record = false;
+}
+
+// Applies the record at the read position to the port states and moves on to the next one. Returns false if the
+// record is cut off, which ends the movie.
+static bool apply_next_movie_record() {
+    const std::vector<uint8_t>& data = movie_state.data;
+    size_t& pos = movie_state.read_pos;
+    if (pos >= data.size()) {
+        movie_state.has_next_record = false;
+        return false;
+    }
+
+    uint8_t port_mask = data[pos++];
+    for (int port = 0; port < recomp::num_n64_ports; port++) {
+        if ((port_mask & (1 << port)) == 0) {
+            continue;
+        }
+        if (pos >= data.size()) {
+            movie_state.has_next_record = false;
+            return false;
+        }
+        uint8_t fields = data[pos++];
+        size_t fields_size = ((fields & movie_field_connected) ? 1 : 0) + ((fields & movie_field_buttons) ? 2 : 0) +
+            ((fields & movie_field_x) ? 4 : 0) + ((fields & movie_field_y) ? 4 : 0);
+        if (data.size() - pos < fields_size) {
+            movie_state.has_next_record = false;
+            return false;
+        }
+
+        MoviePortState& cur = movie_state.ports[port];
+        if (fields & movie_field_connected) {
+            cur.connected = data[pos] != 0;
+            pos += 1;
+        }
+        if (fields & movie_field_buttons) {
+            cur.buttons = uint16_t(data[pos] | (data[pos + 1] << 8));
+            pos += 2;
+        }
+        if (fields & movie_field_x) {
+            cur.x = std::bit_cast<float>(read_u32(&data[pos]));
+            pos += 4;
+        }
+        if (fields & movie_field_y) {
+            cur.y = std::bit_cast<float>(read_u32(&data[pos]));
+            pos += 4;
+        }
+    }
+
+    read_next_record_poll();
+    return true;
+}
+
+// Applies every record for the current poll to the port states.
+static void apply_movie_records() {
+    while (movie_state.has_next_record && movie_state.next_record_poll <= movie_state.poll_index) {
+        if (!apply_next_movie_record()) {
+            return;
+        }
+    }
+}
+
+// Rewinds playback to the start of the movie.
+static void rewind_movie() {
+    movie_state.read_pos = movie_header_size;
+    movie_state.poll_index = 0;
+    movie_state.ports = {};
+    movie_state.next_record_poll = 0;
+    read_next_record_poll();
+}
+
+// Finds the ports that were connected at any point by going through every record. The header's mask is only filled
+// in when a recording stops cleanly, so it's missing from recordings that were cut off.
+static uint32_t find_movie_ports_used() {
+    uint32_t ports_used = 0;
+    rewind_movie();
+    while (movie_state.has_next_record && apply_next_movie_record()) {
+        for (int port = 0; port < recomp::num_n64_ports; port++) {
+            ports_used |= movie_state.ports[port].connected ? (1u << port) : 0;
+        }
+    }
+    return ports_used;
+}
+
+bool zelda64::input::start_movie_recording(const std::filesystem::path& path) {
+    if (movie_state.gate.is_open()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    movie_state.file = _wfopen(path.c_str(), L"wb");
+#else
+    movie_state.file = fopen(path.c_str(), "wb");
+#endif
+    if (movie_state.file == nullptr) {
+        return false;
+    }
+
+    // The mask of used ports is filled in once the recording stops.
+    write_movie_header(movie_state.file, 0);
+
+    movie_state.queue = std::make_unique<SpscRingBuffer<uint8_t>>(movie_queue_size);
+    movie_state.poll_index = 0;
+    movie_state.ports = {};
+    movie_state.written_ports = {};
+    movie_state.ports_used = 0;
+    movie_state.last_record_poll = 0;
+    movie_state.overflowed = false;
+    movie_state.stop_requested = false;
+    movie_state.writer_thread = std::thread{movie_writer_thread};
+    movie_state.mode.store(MovieMode::Recording, std::memory_order_relaxed);
+    movie_state.gate.open();
+    return true;
+}
+
+bool zelda64::input::start_movie_playback(const std::filesystem::path& path) {
+    if (movie_state.gate.is_open()) {
+        return false;
+    }
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    file = _wfopen(path.c_str(), L"rb");
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t read_count;
+    while ((read_count = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+        data.insert(data.end(), chunk, chunk + read_count);
+    }
+    fclose(file);
+
+    if (data.size() < movie_header_size || memcmp(data.data(), movie_magic, sizeof(movie_magic)) != 0 ||
+        read_u32(&data[8]) != movie_version)
+    {
+        return false;
+    }
+
+    uint32_t header_ports_used = read_u32(&data[12]);
+    movie_state.data = std::move(data);
+    movie_state.ports_used = header_ports_used | find_movie_ports_used();
+    rewind_movie();
+    // Apply anything read before the first poll.
+    apply_movie_records();
+    movie_state.mode.store(MovieMode::Playback, std::memory_order_relaxed);
+    movie_state.gate.open();
+    return true;
+}
+
+void zelda64::input::stop_movie() {
+    // Wait for the game thread to be done with the movie, after which it's safe to flush and free it here.
+    if (!movie_state.gate.close()) {
+        return;
+    }
+
+    switch (movie_state.mode.exchange(MovieMode::None, std::memory_order_relaxed)) {
+    case MovieMode::None:
+        return;
+    case MovieMode::Recording:
+        flush_movie_record();
+        movie_state.stop_requested.store(true, std::memory_order_release);
+        movie_state.writer_thread.join();
+
+        fseek(movie_state.file, 0, SEEK_SET);
+        write_movie_header(movie_state.file, movie_state.ports_used);
+        fclose(movie_state.file);
+        movie_state.file = nullptr;
+        movie_state.queue.reset();
+        break;
+    case MovieMode::Playback:
+        if (movie_state.has_next_record) {
+            fprintf(stderr, "Input movie playback stopped at poll %llu before the end of the movie\n",
+                (unsigned long long)movie_state.poll_index);
+        }
+        movie_state.data.clear();
+        break;
+    }
+}
+
+void zelda64::input::advance_movie_poll() {
+    if (!movie_state.gate.try_enter()) {
+        return;
+    }
+
+    switch (movie_state.mode.load(std::memory_order_relaxed)) {
+    case MovieMode::None:
+        break;
+    case MovieMode::Recording:
+        flush_movie_record();
+        movie_state.poll_index++;
+        break;
+    case MovieMode::Playback:
+        movie_state.poll_index++;
+        apply_movie_records();
+        break;
+    }
+
+    movie_state.gate.leave();
+}
+
+bool zelda64::input::movie_recording() {
+    return movie_state.gate.is_open() && movie_state.mode.load(std::memory_order_relaxed) == MovieMode::Recording;
+}
+
+bool zelda64::input::movie_playing() {
+    return movie_state.gate.is_open() && movie_state.mode.load(std::memory_order_relaxed) == MovieMode::Playback;
+}
+
+void zelda64::input::record_movie_input(int port, bool connected, uint16_t buttons, float x, float y) {
+    if (port < 0 || port >= recomp::num_n64_ports || !movie_state.gate.try_enter()) {
+        return;
+    }
+
+    movie_state.ports[port] = { connected, buttons, x, y };
+    movie_state.ports_used |= connected ? (1u << port) : 0;
+    movie_state.gate.leave();
+}
+
+bool zelda64::input::get_movie_input(int port, uint16_t* buttons_out, float* x_out, float* y_out) {
+    if (port < 0 || port >= recomp::num_n64_ports) {
+        return false;
+    }
+
+    const MoviePortState& cur = movie_state.ports[port];
+    *buttons_out = cur.buttons;
+    *x_out = cur.x;
+    *y_out = cur.y;
+    return cur.connected;
+}
+
+bool zelda64::input::movie_port_used(int port) {
+    return port >= 0 && port < recomp::num_n64_ports && (movie_state.ports_used & (1u << port)) != 0;
+}
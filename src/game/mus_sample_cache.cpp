@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "recomp.h"
+#include "librecomp/game.hpp"
+#include "librecomp/helpers.hpp"
+
+#include "../../patches/mus_dma.h"
+
+// Physical address of the start of the cartridge ROM on the PI bus. The music driver's sample addresses are ROM offsets.
+constexpr uint32_t cart_rom_base = 0x10000000;
+
+struct SampleSlot {
+    uint32_t page;
+    // ROM offset up to which the slot has been filled. Slots are filled on demand, so only bytes that the driver
+    // actually requested are ever read, which keeps reads from running past the end of the ROM.
+    uint32_t loaded_end;
+    uint64_t last_use;
+    // Audio frame that last used the slot.
+    uint64_t last_frame;
+    bool valid;
+};
+
+// Only the music driver's audio thread calls into the cache, so it doesn't need synchronization.
+struct SampleCache {
+    SampleSlot slots[MUS_SAMPLE_SLOT_COUNT];
+    uint64_t use_counter;
+    uint64_t frame;
+    bool reported_overflow;
+};
+
+static SampleCache sample_cache{};
+
+// Slots used by the frame being built or the previous one can't be replaced. The command list being built still
+// points into them, and the previous frame's task may still be running on the RSP, e.g. on the audio task thread.
+static bool slot_in_use(const SampleSlot& slot) {
+    return slot.valid && slot.last_frame + 1 >= sample_cache.frame;
+}
+
+static bool evict_before(const SampleSlot& slot, const SampleSlot& other) {
+    if (!slot.valid || !other.valid) {
+        return !slot.valid && other.valid;
+    }
+    if (slot_in_use(slot) != slot_in_use(other)) {
+        return !slot_in_use(slot);
+    }
+    return slot.last_use < other.last_use;
+}
+
+static SampleSlot& find_slot(uint32_t page, size_t& slot_index_out) {
+    // Linear search, as the slot table is small enough to stay in cache and is far cheaper than the DMA it replaces.
+    size_t lru_index = 0;
+    for (size_t i = 0; i < MUS_SAMPLE_SLOT_COUNT; i++) {
+        SampleSlot& slot = sample_cache.slots[i];
+        if (slot.valid && slot.page == page) {
+            slot_index_out = i;
+            return slot;
+        }
+        if (evict_before(slot, sample_cache.slots[lru_index])) {
+            lru_index = i;
+        }
+    }
+
+    SampleSlot& slot = sample_cache.slots[lru_index];
+    if (slot_in_use(slot) && !sample_cache.reported_overflow) {
+        fprintf(stderr, "Music sample cache overflowed, audio may glitch. Increase MUS_SAMPLE_SLOT_COUNT\n");
+        sample_cache.reported_overflow = true;
+    }
+    slot.page = page;
+    slot.loaded_end = page;
+    slot.valid = true;
+    slot_index_out = lru_index;
+    return slot;
+}
+
+// Serves a sample data request from the music driver out of resident ROM pages. A hit hands back a pointer into a
+// slot, and a miss reads just the missing bytes straight from the ROM image. Returns the physical address of the data.
+extern "C" void recomp_load_mus_sample(uint8_t* rdram, recomp_context* ctx) {
+    uint32_t addr = _arg<0, uint32_t>(rdram, ctx);
+    uint32_t len = _arg<1, uint32_t>(rdram, ctx);
+    gpr slots_vram = _arg<2, gpr>(rdram, ctx);
+
+    if (len > MUS_SAMPLE_PAGE_SIZE) {
+        fprintf(stderr, "Music sample request of 0x%X bytes is larger than a page, truncating\n", len);
+        len = MUS_SAMPLE_PAGE_SIZE;
+    }
+
+    uint32_t page = addr & ~uint32_t(MUS_SAMPLE_PAGE_SIZE - 1);
+    size_t slot_index;
+    SampleSlot& slot = find_slot(page, slot_index);
+    slot.last_use = ++sample_cache.use_counter;
+    slot.last_frame = sample_cache.frame;
+    gpr slot_vram = slots_vram + gpr(slot_index * MUS_SAMPLE_SLOT_SIZE);
+
+    // Extend the resident data to cover the request, rounded to the 8 byte alignment that the RSP's DMA uses.
+    uint32_t request_end = (addr + len + 7) & ~7u;
+    if (request_end > slot.loaded_end) {
+        uint32_t load_start = slot.loaded_end;
+        recomp::do_rom_read(rdram, slot_vram + gpr(load_start - page), cart_rom_base + load_start, request_end - load_start);
+        slot.loaded_end = request_end;
+    }
+
+    _return<uint32_t>(ctx, uint32_t(slot_vram + (addr - page)) & 0x1FFFFFFF);
+}
+
+// Called once per audio frame by the music driver.
+extern "C" void recomp_mus_sample_new_frame(uint8_t* rdram, recomp_context* ctx) {
+    sample_cache.frame++;
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <chrono>
+
+#include "SDL.h"
+
+#include "audio_backend.h"
+#include "spsc_ring_buffer.h"
+#include "zelda_audio_stats.h"
+
+bool zelda64::audio::backend_type_from_string(std::string_view name, BackendType& type_out) {
+    if (name == "queue") {
+        type_out = BackendType::SDLQueue;
+        return true;
+    }
+    if (name == "callback") {
+        type_out = BackendType::SDLCallback;
+        return true;
+    }
+    if (name == "null") {
+        type_out = BackendType::Null;
+        return true;
+    }
+    if (name == "null_fast") {
+        type_out = BackendType::NullFast;
+        return true;
+    }
+    return false;
+}
+
+bool zelda64::audio::backend_uses_sdl(BackendType type) {
+    switch (type) {
+        case BackendType::SDLQueue:
+        case BackendType::SDLCallback:
+            return true;
+        case BackendType::Null:
+        case BackendType::NullFast:
+            return false;
+    }
+
+    return false;
+}
+
+// Fairly small sample count to reduce the latency of internal buffering.
+constexpr Uint16 device_buffer_frames = 0x100;
+
+static SDL_AudioDeviceID open_sdl_device(uint32_t output_rate, uint32_t channels, SDL_AudioCallback callback, void* userdata) {
+    SDL_AudioSpec spec_desired{
+        .freq = (int)output_rate,
+        .format = AUDIO_F32,
+        .channels = (Uint8)channels,
+        .silence = 0, // calculated
+        .samples = device_buffer_frames,
+        .padding = 0, // unused
+        .size = 0, // calculated
+        .callback = callback,
+        .userdata = userdata
+    };
+
+    return SDL_OpenAudioDevice(nullptr, false, &spec_desired, nullptr, 0);
+}
+
+class SDLQueueBackend final : public zelda64::audio::Backend {
+public:
+    ~SDLQueueBackend() override {
+        if (device != 0) {
+            SDL_CloseAudioDevice(device);
+        }
+    }
+
+    bool open(uint32_t output_rate, uint32_t channels) override {
+        device = open_sdl_device(output_rate, channels, nullptr, nullptr);
+        if (device == 0) {
+            return false;
+        }
+        bytes_per_frame = channels * sizeof(float);
+        SDL_PauseAudioDevice(device, 0);
+        return true;
+    }
+
+    void queue_frames(const float* frames, size_t frame_count) override {
+        // SDL doesn't report underruns for queued audio, so treat finding the queue empty after it was fed as one.
+        if (has_queued && SDL_GetQueuedAudioSize(device) == 0) {
+            zelda64::audio::record_device_underrun();
+        }
+        SDL_QueueAudio(device, frames, frame_count * bytes_per_frame);
+        has_queued = true;
+    }
+
+    size_t get_queued_frames() override {
+        return SDL_GetQueuedAudioSize(device) / bytes_per_frame;
+    }
+
+private:
+    SDL_AudioDeviceID device = 0;
+    uint32_t bytes_per_frame = 0;
+    bool has_queued = false;
+};
+
+class SDLCallbackBackend final : public zelda64::audio::Backend {
+public:
+    ~SDLCallbackBackend() override {
+        if (device != 0) {
+            SDL_CloseAudioDevice(device);
+        }
+    }
+
+    bool open(uint32_t output_rate, uint32_t new_channels) override {
+        channels = new_channels;
+        // Hold up to about a second of audio. queue_samples keeps the actual latency far below this.
+        samples = std::make_unique<zelda64::SpscRingBuffer<float>>(size_t(output_rate) * channels);
+
+        device = open_sdl_device(output_rate, channels, device_callback, this);
+        if (device == 0) {
+            return false;
+        }
+        SDL_PauseAudioDevice(device, 0);
+        return true;
+    }
+
+    void queue_frames(const float* frames, size_t frame_count) override {
+        // Anything that doesn't fit is dropped, which can only happen if the device has stopped consuming audio.
+        samples->write(frames, frame_count * channels);
+    }
+
+    size_t get_queued_frames() override {
+        return samples->size() / channels;
+    }
+
+    size_t get_capacity_frames() const override {
+        return samples->get_capacity() / channels;
+    }
+
+private:
+    SDL_AudioDeviceID device = 0;
+    uint32_t channels = 0;
+    std::unique_ptr<zelda64::SpscRingBuffer<float>> samples;
+    // Only accessed from the device callback.
+    bool has_read = false;
+
+    // Runs on SDL's audio device thread.
+    static void device_callback(void* userdata, Uint8* stream, int len) {
+        SDLCallbackBackend* backend = static_cast<SDLCallbackBackend*>(userdata);
+        float* output = reinterpret_cast<float*>(stream);
+        size_t sample_count = size_t(len) / sizeof(float);
+
+        size_t read_count = backend->samples->read(output, sample_count);
+
+        // Fill the rest of the buffer with silence if the game hasn't provided enough audio.
+        if (read_count < sample_count) {
+            std::fill(output + read_count, output + sample_count, 0.0f);
+            // Only count underruns once audio has started, as the device starts running before the game queues anything.
+            if (backend->has_read) {
+                zelda64::audio::record_device_underrun();
+            }
+        }
+        backend->has_read |= read_count != 0;
+    }
+};
+
+class NullBackend final : public zelda64::audio::Backend {
+public:
+    NullBackend(bool realtime) : realtime{realtime} {}
+
+    bool open(uint32_t new_output_rate, uint32_t channels) override {
+        output_rate = new_output_rate;
+        queued_frames = 0.0;
+        last_update = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void queue_frames(const float* frames, size_t frame_count) override {
+        if (!realtime) {
+            return;
+        }
+
+        advance_clock();
+        if (has_queued && queued_frames == 0.0) {
+            zelda64::audio::record_device_underrun();
+        }
+        queued_frames += double(frame_count);
+        has_queued = true;
+    }
+
+    size_t get_queued_frames() override {
+        if (!realtime) {
+            return 0;
+        }
+
+        advance_clock();
+        return size_t(queued_frames);
+    }
+
+    bool consumes_in_real_time() const override {
+        return realtime;
+    }
+
+private:
+    bool realtime;
+    uint32_t output_rate = 0;
+    bool has_queued = false;
+    // Kept fractional so that the virtual clock doesn't drift from rounding when it's advanced in small steps.
+    double queued_frames = 0.0;
+    std::chrono::steady_clock::time_point last_update;
+
+    // Consumes the frames that a device running at the output rate would have played since the last update.
+    void advance_clock() {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed_seconds = std::chrono::duration<double>(now - last_update).count();
+        last_update = now;
+
+        queued_frames = std::max(0.0, queued_frames - elapsed_seconds * output_rate);
+    }
+};
+
+std::unique_ptr<zelda64::audio::Backend> zelda64::audio::create_backend(BackendType type) {
+    switch (type) {
+        case BackendType::SDLQueue:
+            return std::make_unique<SDLQueueBackend>();
+        case BackendType::SDLCallback:
+            return std::make_unique<SDLCallbackBackend>();
+        case BackendType::Null:
+            return std::make_unique<NullBackend>(true);
+        case BackendType::NullFast:
+            return std::make_unique<NullBackend>(false);
+    }
+
+    return nullptr;
+}
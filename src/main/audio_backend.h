@@ -0,0 +1,48 @@
+#ifndef __AUDIO_BACKEND_H__
+#define __AUDIO_BACKEND_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace zelda64 {
+    namespace audio {
+        enum class BackendType {
+            // Pushes samples to the device with SDL_QueueAudio.
+            SDLQueue,
+            // Writes samples to a lock-free ring buffer that an SDL audio callback drains.
+            SDLCallback,
+            // Doesn't open a device. Queued samples are consumed by a virtual clock running at the output rate.
+            Null,
+            // Doesn't open a device and consumes queued samples immediately, which lets the game run as fast as possible.
+            NullFast,
+        };
+
+        // True if the backend needs the SDL audio subsystem.
+        bool backend_uses_sdl(BackendType type);
+
+        // Parses a backend name as given in the RECOMP_AUDIO_BACKEND environment variable. Returns false for unknown names.
+        bool backend_type_from_string(std::string_view name, BackendType& type_out);
+
+        // Output stage of the audio pipeline. Receives interleaved float frames at the output sample rate.
+        class Backend {
+        public:
+            virtual ~Backend() = default;
+            virtual bool open(uint32_t output_rate, uint32_t channels) = 0;
+            // Called from the game's audio thread.
+            virtual void queue_frames(const float* frames, size_t frame_count) = 0;
+            // Number of output frames that have been queued but not yet consumed by the device.
+            virtual size_t get_queued_frames() = 0;
+            // Number of frames the backend can hold. Frames queued past this are dropped.
+            virtual size_t get_capacity_frames() const { return SIZE_MAX; }
+            // False if queued frames aren't consumed at the output rate, in which case get_queued_frames is the only
+            // source of truth for the queue's fill level.
+            virtual bool consumes_in_real_time() const { return true; }
+        };
+
+        std::unique_ptr<Backend> create_backend(BackendType type);
+    }
+}
+
+#endif
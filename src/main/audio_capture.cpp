@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "audio_capture.h"
+#include "spsc_ring_buffer.h"
+
+zelda64::CaptureGate zelda64::audio::detail::capture_gate{};
+
+// Seconds of audio that the queue can hold before the writer thread falls behind and audio starts getting dropped.
+constexpr size_t capture_queue_seconds = 4;
+// How often the writer thread drains the queue. Long enough that each write is a large sequential block.
+constexpr auto capture_write_interval = std::chrono::milliseconds(100);
+
+struct CaptureState {
+    FILE* file = nullptr;
+    bool write_header = false;
+    uint32_t channels = 0;
+    std::atomic<uint32_t> sample_rate = 0;
+    std::unique_ptr<zelda64::SpscRingBuffer<float>> queue;
+    std::atomic<uint64_t> dropped_samples = 0;
+    uint64_t written_samples = 0;
+    std::atomic<bool> stop_requested = false;
+    std::thread writer_thread;
+};
+
+static CaptureState capture_state{};
+
+static void write_u16(uint8_t* out, uint16_t value) {
+    out[0] = uint8_t(value);
+    out[1] = uint8_t(value >> 8);
+}
+
+static void write_u32(uint8_t* out, uint32_t value) {
+    write_u16(out, uint16_t(value));
+    write_u16(out + 2, uint16_t(value >> 16));
+}
+
+// Writes a 32-bit float WAV header at the current file position.
+static void write_wav_header(FILE* file, uint32_t sample_rate, uint32_t channels, uint64_t sample_count) {
+    constexpr uint32_t header_size = 44;
+    constexpr uint16_t format_ieee_float = 3;
+    constexpr uint16_t bits_per_sample = 32;
+    uint8_t header[header_size];
+
+    // Clamp the data size to what fits in the header's 32-bit size fields.
+    uint32_t data_size = uint32_t(std::min<uint64_t>(sample_count * sizeof(float), UINT32_MAX - header_size));
+    uint32_t block_align = channels * sizeof(float);
+
+    memcpy(header + 0, "RIFF", 4);
+    write_u32(header + 4, data_size + header_size - 8);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    write_u32(header + 16, 16);
+    write_u16(header + 20, format_ieee_float);
+    write_u16(header + 22, uint16_t(channels));
+    write_u32(header + 24, sample_rate);
+    write_u32(header + 28, sample_rate * block_align);
+    write_u16(header + 32, uint16_t(block_align));
+    write_u16(header + 34, bits_per_sample);
+    memcpy(header + 36, "data", 4);
+    write_u32(header + 40, data_size);
+
+    fwrite(header, 1, header_size, file);
+}
+
+static void drain_capture_queue(std::vector<float>& chunk) {
+    size_t read_count;
+    while ((read_count = capture_state.queue->read(chunk.data(), chunk.size())) != 0) {
+        fwrite(chunk.data(), sizeof(float), read_count, capture_state.file);
+        capture_state.written_samples += read_count;
+    }
+}
+
+static void capture_writer_thread() {
+    std::vector<float> chunk(size_t{1} << 16);
+
+    while (!capture_state.stop_requested.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(capture_write_interval);
+        drain_capture_queue(chunk);
+    }
+
+    // Write out anything queued between the last drain and the stop request.
+    drain_capture_queue(chunk);
+}
+
+bool zelda64::audio::start_capture(const std::filesystem::path& path, uint32_t sample_rate, uint32_t channels) {
+    if (detail::capture_gate.is_open()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    capture_state.file = _wfopen(path.c_str(), L"wb");
+#else
+    capture_state.file = fopen(path.c_str(), "wb");
+#endif
+    if (capture_state.file == nullptr) {
+        return false;
+    }
+
+    // Let the C runtime batch the writes into large blocks.
+    setvbuf(capture_state.file, nullptr, _IOFBF, size_t{1} << 20);
+
+    capture_state.write_header = path.extension() != ".raw";
+    capture_state.channels = channels;
+    capture_state.sample_rate = sample_rate;
+    capture_state.queue = std::make_unique<SpscRingBuffer<float>>(size_t(sample_rate) * channels * capture_queue_seconds);
+    capture_state.dropped_samples = 0;
+    capture_state.written_samples = 0;
+    capture_state.stop_requested = false;
+
+    // Reserve space for the header, it gets filled in with the final sizes once the capture stops.
+    if (capture_state.write_header) {
+        write_wav_header(capture_state.file, sample_rate, channels, 0);
+    }
+
+    capture_state.writer_thread = std::thread{capture_writer_thread};
+    detail::capture_gate.open();
+    return true;
+}
+
+void zelda64::audio::stop_capture() {
+    // Wait for the audio thread to finish queueing, so that the writer's final drain gets everything and the queue
+    // can be freed.
+    if (!detail::capture_gate.close()) {
+        return;
+    }
+
+    capture_state.stop_requested.store(true, std::memory_order_release);
+    capture_state.writer_thread.join();
+
+    if (capture_state.write_header) {
+        fseek(capture_state.file, 0, SEEK_SET);
+        write_wav_header(capture_state.file, capture_state.sample_rate, capture_state.channels, capture_state.written_samples);
+    }
+    fclose(capture_state.file);
+    capture_state.file = nullptr;
+    capture_state.queue.reset();
+
+    uint64_t dropped = capture_state.dropped_samples.load();
+    if (dropped != 0) {
+        fprintf(stderr, "Audio capture dropped %llu samples because the writer couldn't keep up\n", (unsigned long long)dropped);
+    }
+}
+
+void zelda64::audio::set_capture_rate(uint32_t sample_rate) {
+    capture_state.sample_rate.store(sample_rate, std::memory_order_relaxed);
+}
+
+void zelda64::audio::detail::push_capture_frames(const float* frames, size_t frame_count) {
+    size_t sample_count = frame_count * capture_state.channels;
+    // Drop whole chunks rather than writing part of one, which keeps the channels in the file aligned.
+    // The free space can only grow while this runs, as only the writer thread removes data from the queue.
+    if (capture_state.queue->get_capacity() - capture_state.queue->size() < sample_count) {
+        capture_state.dropped_samples.fetch_add(sample_count, std::memory_order_relaxed);
+        return;
+    }
+    capture_state.queue->write(frames, sample_count);
+}
@@ -0,0 +1,36 @@
+#ifndef __AUDIO_CAPTURE_H__
+#define __AUDIO_CAPTURE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#include "capture_gate.h"
+
+namespace zelda64 {
+    namespace audio {
+        // Starts streaming captured audio to the given path. Files ending in .raw get headerless interleaved 32-bit floats,
+        // anything else is written as a 32-bit float WAV file. Returns false if the file couldn't be opened.
+        bool start_capture(const std::filesystem::path& path, uint32_t sample_rate, uint32_t channels);
+        // Flushes any pending audio, finalizes the file header and stops the writer thread.
+        void stop_capture();
+        // Updates the sample rate written to the file header. The header holds a single rate, so the last one set wins.
+        void set_capture_rate(uint32_t sample_rate);
+
+        namespace detail {
+            extern CaptureGate capture_gate;
+            void push_capture_frames(const float* frames, size_t frame_count);
+        }
+
+        // Called from the audio thread. Never blocks on disk I/O, audio that doesn't fit in the capture queue is dropped.
+        inline void capture_frames(const float* frames, size_t frame_count) {
+            // The gate stops the capture from being torn down while the frames are queued.
+            if (detail::capture_gate.try_enter()) {
+                detail::push_capture_frames(frames, frame_count);
+                detail::capture_gate.leave();
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include <vector>
+
+#include "SDL_cpuinfo.h"
+
+#include "audio_convert.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AUDIO_CONVERT_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define AUDIO_CONVERT_NEON
+#include "sse2neon.h"
+#endif
+
+// Allows compiling individual kernels for instruction sets beyond the ones enabled for the rest of the file.
+#if defined(AUDIO_CONVERT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AUDIO_CONVERT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AUDIO_CONVERT_TARGET(isa)
+#endif
+
+static void convert_samples_scalar(const int16_t* input, float* output, size_t sample_count, float scale) {
+    for (size_t i = 0; i < sample_count; i += 2) {
+        output[i + 0] = input[i + 1] * scale;
+        output[i + 1] = input[i + 0] * scale;
+    }
+}
+
+#if defined(AUDIO_CONVERT_X86) || defined(AUDIO_CONVERT_NEON)
+// SSE4.1 kernel, which is also used for NEON through sse2neon. Processes 4 frames per iteration.
+AUDIO_CONVERT_TARGET("sse4.1")
+static void convert_samples_sse41(const int16_t* input, float* output, size_t sample_count, float scale) {
+    const __m128 scale_vec = _mm_set1_ps(scale);
+    size_t i = 0;
+
+    for (; i + 8 <= sample_count; i += 8) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        // Swap the two 16-bit samples of every frame.
+        samples = _mm_shufflelo_epi16(samples, _MM_SHUFFLE(2, 3, 0, 1));
+        samples = _mm_shufflehi_epi16(samples, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m128 low = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(samples));
+        __m128 high = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_unpackhi_epi64(samples, samples)));
+
+        _mm_storeu_ps(output + i + 0, _mm_mul_ps(low, scale_vec));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(high, scale_vec));
+    }
+
+    convert_samples_scalar(input + i, output + i, sample_count - i, scale);
+}
+#endif
+
+#if defined(AUDIO_CONVERT_X86)
+// AVX2 kernel. Processes 8 frames per iteration.
+AUDIO_CONVERT_TARGET("avx2")
+static void convert_samples_avx2(const int16_t* input, float* output, size_t sample_count, float scale) {
+    const __m256 scale_vec = _mm256_set1_ps(scale);
+    size_t i = 0;
+
+    for (; i + 16 <= sample_count; i += 16) {
+        __m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        // Swap the two 16-bit samples of every frame.
+        samples = _mm256_shufflelo_epi16(samples, _MM_SHUFFLE(2, 3, 0, 1));
+        samples = _mm256_shufflehi_epi16(samples, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(samples)));
+        __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(samples, 1)));
+
+        _mm256_storeu_ps(output + i + 0, _mm256_mul_ps(low, scale_vec));
+        _mm256_storeu_ps(output + i + 8, _mm256_mul_ps(high, scale_vec));
+    }
+
+    // Clear the upper halves of the registers before running the non-VEX scalar tail to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    convert_samples_scalar(input + i, output + i, sample_count - i, scale);
+}
+#endif
+
+static std::vector<zelda64::audio::ConvertKernel> find_supported_kernels() {
+    std::vector<zelda64::audio::ConvertKernel> ret{};
+    ret.emplace_back(zelda64::audio::ConvertKernel{ "Scalar", convert_samples_scalar });
+
+#if defined(AUDIO_CONVERT_X86)
+    if (SDL_HasSSE41()) {
+        ret.emplace_back(zelda64::audio::ConvertKernel{ "SSE4.1", convert_samples_sse41 });
+    }
+    if (SDL_HasAVX2()) {
+        ret.emplace_back(zelda64::audio::ConvertKernel{ "AVX2", convert_samples_avx2 });
+    }
+#elif defined(AUDIO_CONVERT_NEON)
+    ret.emplace_back(zelda64::audio::ConvertKernel{ "NEON", convert_samples_sse41 });
+#endif
+
+    return ret;
+}
+
+std::span<const zelda64::audio::ConvertKernel> zelda64::audio::get_supported_convert_kernels() {
+    static const std::vector<zelda64::audio::ConvertKernel> supported_kernels = find_supported_kernels();
+    return supported_kernels;
+}
+
+void zelda64::audio::convert_samples(const int16_t* input, float* output, size_t sample_count, float scale) {
+    static ConvertFunc* const best_kernel = get_supported_convert_kernels().back().func;
+    best_kernel(input, output, sample_count, scale);
+}
@@ -0,0 +1,27 @@
+#ifndef __AUDIO_CONVERT_H__
+#define __AUDIO_CONVERT_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+namespace zelda64 {
+    namespace audio {
+        // Converts interleaved 16-bit stereo samples to floats multiplied by `scale`, swapping the two channels of every
+        // frame to correct for the address xor caused by endianness handling. `sample_count` must be a multiple of 2.
+        using ConvertFunc = void(const int16_t* input, float* output, size_t sample_count, float scale);
+
+        struct ConvertKernel {
+            const char* name;
+            ConvertFunc* func;
+        };
+
+        // Converts using the fastest kernel supported by the current CPU, which is picked on the first call.
+        void convert_samples(const int16_t* input, float* output, size_t sample_count, float scale);
+
+        // Every kernel supported by the current CPU, ordered from slowest to fastest. The first entry is always the scalar fallback.
+        std::span<const ConvertKernel> get_supported_convert_kernels();
+    }
+}
+
+#endif
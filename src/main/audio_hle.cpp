@@ -0,0 +1,754 @@
+// The audio command handlers are derived from the ABI 1 audio list code of mupen64plus-rsp-hle
+// (https://github.com/mupen64plus/mupen64plus-rsp-hle), Copyright (C) 2002 Hacktarux, (C) 2009 Richard Goedeken and
+// (C) 2014 Bobby Smiles, used under the terms of the GNU General Public License version 2 or later. That license
+// allows distributing the derived code under the GPL version 3 that covers this project (see COPYING).
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "ultramodern/ultra64.h"
+
+#include "audio_hle.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AUDIO_HLE_SIMD
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define AUDIO_HLE_SIMD
+#include "sse2neon.h"
+#endif
+
+// The runtime stores RDRAM and DMEM as native-endian 32-bit words, so halfwords and bytes are accessed with the
+// address xor'd by 2 and 3 respectively. Keeping the same layout lets native and recompiled tasks share memory.
+constexpr uint32_t dmem_mask = 0xFFF;
+constexpr uint32_t rdram_mask = 0xFFFFFF;
+
+// Offset that the microcode adds to every buffer address in the command list.
+constexpr uint16_t dmem_base = 0x5C0;
+// Location of the OSTask that the runtime copies into DMEM before starting a task.
+constexpr uint32_t dmem_task_offset = 0xFC0;
+
+constexpr size_t segment_count = 16;
+constexpr size_t num_opcodes = 16;
+
+// Command flags, matching libultra's abi.h.
+constexpr uint8_t A_INIT = 0x01;
+constexpr uint8_t A_LOOP = 0x02;
+constexpr uint8_t A_LEFT = 0x02;
+constexpr uint8_t A_VOL = 0x04;
+constexpr uint8_t A_AUX = 0x08;
+
+// First row of the resampler's filter table. The table is part of the microcode's data, so it's located in DMEM
+// instead of duplicating it here.
+constexpr uint16_t resample_table_signature[4] = { 0x0C39, 0x66AD, 0x0D46, 0xFFDF };
+constexpr size_t resample_table_rows = 64;
+
+struct AudioState {
+    uint8_t* rdram;
+    uint8_t* dmem;
+    uint32_t segments[segment_count];
+    uint16_t in;
+    uint16_t out;
+    uint16_t count;
+    uint16_t dry_right;
+    uint16_t wet_left;
+    uint16_t wet_right;
+    int16_t dry;
+    int16_t wet;
+    int16_t vol[2];
+    int16_t target[2];
+    int32_t rate[2];
+    uint32_t loop;
+    int16_t adpcm_table[16 * 8];
+    int16_t resample_table[resample_table_rows * 4];
+};
+
+static inline int16_t clamp_s16(int32_t value) {
+    return int16_t(std::clamp(value, int32_t{INT16_MIN}, int32_t{INT16_MAX}));
+}
+
+static inline uint16_t align(uint16_t value, uint16_t alignment) {
+    return (value + (alignment - 1)) & ~(alignment - 1);
+}
+
+static inline uint8_t& dmem_u8(AudioState& state, uint16_t addr) {
+    return state.dmem[(addr & dmem_mask) ^ 3];
+}
+
+static inline int16_t& dmem_s16(AudioState& state, uint16_t addr) {
+    return *reinterpret_cast<int16_t*>(state.dmem + ((addr & dmem_mask) ^ 2));
+}
+
+// Accesses DMEM by sample index rather than byte address.
+static inline int16_t& dmem_sample(AudioState& state, uint16_t pos) {
+    return reinterpret_cast<int16_t*>(state.dmem)[(pos ^ 1) & (dmem_mask >> 1)];
+}
+
+static inline uint16_t& rdram_u16(AudioState& state, uint32_t addr) {
+    return *reinterpret_cast<uint16_t*>(state.rdram + ((addr & rdram_mask) ^ 2));
+}
+
+static void rdram_load_u16(AudioState& state, int16_t* dst, uint32_t addr, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = int16_t(rdram_u16(state, addr + 2 * i));
+    }
+}
+
+static void rdram_store_u16(AudioState& state, const int16_t* src, uint32_t addr, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        rdram_u16(state, addr + 2 * i) = uint16_t(src[i]);
+    }
+}
+
+static uint32_t get_address(const AudioState& state, uint32_t segmented) {
+    uint32_t segment = (segmented >> 24) & (segment_count - 1);
+    return (state.segments[segment] + (segmented & rdram_mask)) & rdram_mask;
+}
+
+// True if `count` bytes at `addr` are word aligned and don't wrap around the end of DMEM, in which case consecutive
+// samples are stored contiguously (in pairs swapped by the word layout) and can be processed with vector operations.
+static inline bool dmem_contiguous(uint16_t addr, uint16_t count) {
+    return (addr & 3) == 0 && (addr & dmem_mask) + count <= dmem_mask + 1;
+}
+
+static inline void sample_mix(int16_t& dst, int16_t src, int16_t gain) {
+    dst = clamp_s16(dst + ((int32_t(src) * gain) >> 15));
+}
+
+#if defined(AUDIO_HLE_SIMD)
+// Mixes 8 samples with per-lane gains, matching sample_mix exactly: the full 32-bit product is shifted and the sum is
+// saturated when packing back down to 16 bits.
+static inline void mix8(int16_t* dst, __m128i src, __m128i gains) {
+    __m128i dst_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+    __m128i prod_lo16 = _mm_mullo_epi16(src, gains);
+    __m128i prod_hi16 = _mm_mulhi_epi16(src, gains);
+    __m128i prod_lo = _mm_srai_epi32(_mm_unpacklo_epi16(prod_lo16, prod_hi16), 15);
+    __m128i prod_hi = _mm_srai_epi32(_mm_unpackhi_epi16(prod_lo16, prod_hi16), 15);
+    __m128i dst_lo = _mm_srai_epi32(_mm_unpacklo_epi16(dst_vec, dst_vec), 16);
+    __m128i dst_hi = _mm_srai_epi32(_mm_unpackhi_epi16(dst_vec, dst_vec), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packs_epi32(_mm_add_epi32(dst_lo, prod_lo), _mm_add_epi32(dst_hi, prod_hi)));
+}
+#endif
+
+static void cmd_clearbuff(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint16_t dmem = uint16_t(w1) + dmem_base;
+    uint16_t count = w2 & 0xFFF;
+    if (count == 0) {
+        return;
+    }
+
+    count = align(count, 16);
+    for (uint16_t i = 0; i < count; i++) {
+        dmem_u8(state, dmem + i) = 0;
+    }
+}
+
+static void cmd_loadbuff(AudioState& state, uint32_t w1, uint32_t w2) {
+    if (state.count == 0) {
+        return;
+    }
+
+    // Matches the DMA engine's alignment constraints. Both memories use the same word layout, so this is a plain copy.
+    uint16_t dmem = state.in & ~3;
+    uint32_t address = get_address(state, w2) & ~7;
+    uint16_t count = std::min<uint16_t>(align(state.count, 8), (dmem_mask + 1) - (dmem & dmem_mask));
+    memcpy(state.dmem + (dmem & dmem_mask), state.rdram + address, count);
+}
+
+static void cmd_savebuff(AudioState& state, uint32_t w1, uint32_t w2) {
+    if (state.count == 0) {
+        return;
+    }
+
+    uint16_t dmem = state.out & ~3;
+    uint32_t address = get_address(state, w2) & ~7;
+    uint16_t count = std::min<uint16_t>(align(state.count, 8), (dmem_mask + 1) - (dmem & dmem_mask));
+    memcpy(state.rdram + address, state.dmem + (dmem & dmem_mask), count);
+}
+
+static void cmd_segment(AudioState& state, uint32_t w1, uint32_t w2) {
+    state.segments[(w2 >> 24) & (segment_count - 1)] = w2 & rdram_mask;
+}
+
+static void cmd_setbuff(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    if (flags & A_AUX) {
+        state.dry_right = uint16_t(w1) + dmem_base;
+        state.wet_left = uint16_t(w2 >> 16) + dmem_base;
+        state.wet_right = uint16_t(w2) + dmem_base;
+    }
+    else {
+        state.in = uint16_t(w1) + dmem_base;
+        state.out = uint16_t(w2 >> 16) + dmem_base;
+        state.count = uint16_t(w2);
+    }
+}
+
+static void cmd_setvol(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    if (flags & A_VOL) {
+        if (flags & A_LEFT) {
+            state.vol[0] = int16_t(w1);
+            state.dry = int16_t(w2 >> 16);
+            state.wet = int16_t(w2);
+        }
+        else {
+            state.vol[1] = int16_t(w1);
+        }
+    }
+    else {
+        if (flags & A_LEFT) {
+            state.target[0] = int16_t(w1);
+            state.rate[0] = int32_t(w2);
+        }
+        else {
+            state.target[1] = int16_t(w1);
+            state.rate[1] = int32_t(w2);
+        }
+    }
+}
+
+static void cmd_setloop(AudioState& state, uint32_t w1, uint32_t w2) {
+    state.loop = get_address(state, w2);
+}
+
+static void cmd_dmemmove(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint16_t dmemi = uint16_t(w1) + dmem_base;
+    uint16_t dmemo = uint16_t(w2 >> 16) + dmem_base;
+    uint16_t count = uint16_t(w2);
+    if (count == 0) {
+        return;
+    }
+
+    // Byte by byte in order, as the microcode allows overlapping moves.
+    count = align(count, 16);
+    for (uint16_t i = 0; i < count; i++) {
+        dmem_u8(state, dmemo + i) = dmem_u8(state, dmemi + i);
+    }
+}
+
+static void cmd_loadadpcm(AudioState& state, uint32_t w1, uint32_t w2) {
+    size_t count = std::min<size_t>(align(uint16_t(w1), 8) / 2, std::size(state.adpcm_table));
+    rdram_load_u16(state, state.adpcm_table, get_address(state, w2), count);
+}
+
+// Applies the ADPCM predictor to 8 samples. `last_samples` points to the two samples that precede `src`.
+static void adpcm_compute_residuals(int16_t* dst, const int16_t* src, const int16_t* codebook_entry, const int16_t* last_samples) {
+    const int16_t* book1 = codebook_entry;
+    const int16_t* book2 = codebook_entry + 8;
+    int32_t l1 = last_samples[0];
+    int32_t l2 = last_samples[1];
+
+    for (size_t i = 0; i < 8; i++) {
+        int32_t accum = int32_t(src[i]) << 11;
+        accum += book1[i] * l1 + book2[i] * l2;
+        for (size_t j = 0; j < i; j++) {
+            accum += book2[j] * src[i - 1 - j];
+        }
+        dst[i] = clamp_s16(accum >> 11);
+    }
+}
+
+static void cmd_adpcm(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    uint32_t address = get_address(state, w2);
+    uint16_t dmemi = state.in;
+    uint16_t dmemo = state.out;
+    uint16_t count = align(state.count, 32);
+    int16_t last_frame[16];
+
+    if (flags & A_INIT) {
+        std::fill(std::begin(last_frame), std::end(last_frame), 0);
+    }
+    else {
+        rdram_load_u16(state, last_frame, (flags & A_LOOP) ? state.loop : address, 16);
+    }
+
+    for (size_t i = 0; i < 16; i++, dmemo += 2) {
+        dmem_s16(state, dmemo) = last_frame[i];
+    }
+
+    while (count != 0) {
+        uint8_t header = dmem_u8(state, dmemi++);
+        uint32_t scale = header >> 4;
+        uint32_t rshift = (scale < 12) ? 12 - scale : 0;
+        const int16_t* codebook_entry = state.adpcm_table + ((header & 0xF) << 4);
+
+        // Unpack the 16 4-bit samples of this frame.
+        int16_t frame[16];
+        for (size_t i = 0; i < 8; i++) {
+            uint8_t byte = dmem_u8(state, dmemi++);
+            frame[2 * i + 0] = int16_t(uint16_t(byte & 0xF0) << 8) >> rshift;
+            frame[2 * i + 1] = int16_t(uint16_t(byte & 0x0F) << 12) >> rshift;
+        }
+
+        adpcm_compute_residuals(last_frame, frame, codebook_entry, last_frame + 14);
+        adpcm_compute_residuals(last_frame + 8, frame + 8, codebook_entry, last_frame + 6);
+
+        for (size_t i = 0; i < 16; i++, dmemo += 2) {
+            dmem_s16(state, dmemo) = last_frame[i];
+        }
+
+        count -= 32;
+    }
+
+    rdram_store_u16(state, last_frame, address, 16);
+}
+
+static void cmd_resample(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    uint32_t pitch = uint32_t(uint16_t(w1)) << 1;
+    uint32_t address = get_address(state, w2);
+    uint16_t ipos = (state.in >> 1) - 4;
+    uint16_t opos = state.out >> 1;
+    uint16_t count = align(state.count, 16) >> 1;
+    uint32_t pitch_accum;
+
+    // The four samples before the input buffer hold the filter history from the previous task.
+    if (flags & A_INIT) {
+        for (uint16_t k = 0; k < 4; k++) {
+            dmem_sample(state, ipos + k) = 0;
+        }
+        pitch_accum = 0;
+    }
+    else {
+        for (uint16_t k = 0; k < 4; k++) {
+            dmem_sample(state, ipos + k) = int16_t(rdram_u16(state, address + 2 * k));
+        }
+        pitch_accum = rdram_u16(state, address + 8);
+    }
+
+    while (count != 0) {
+        const int16_t* coefficients = state.resample_table + ((pitch_accum & 0xFC00) >> 8);
+        // The products are summed at full precision and shifted once, as in the RSP's accumulator. A row's coefficients
+        // add up to about 1.0, so the sum fits in 32 bits.
+        int32_t accum =
+            dmem_sample(state, ipos + 0) * coefficients[0] +
+            dmem_sample(state, ipos + 1) * coefficients[1] +
+            dmem_sample(state, ipos + 2) * coefficients[2] +
+            dmem_sample(state, ipos + 3) * coefficients[3];
+        dmem_sample(state, opos++) = clamp_s16(accum >> 15);
+
+        pitch_accum += pitch;
+        ipos += uint16_t(pitch_accum >> 16);
+        pitch_accum &= 0xFFFF;
+        count--;
+    }
+
+    for (uint16_t k = 0; k < 4; k++) {
+        rdram_u16(state, address + 2 * k) = uint16_t(dmem_sample(state, ipos + k));
+    }
+    rdram_u16(state, address + 8) = uint16_t(pitch_accum);
+}
+
+// Number of halfwords of envelope state that the envelope mixer saves to RDRAM between tasks.
+constexpr size_t envmixer_state_halfwords = 20;
+
+struct Ramp {
+    int32_t value;
+    int32_t step;
+    int32_t target;
+};
+
+static inline int16_t ramp_step(Ramp& ramp) {
+    ramp.value += ramp.step;
+
+    bool target_reached = (ramp.step <= 0) ? (ramp.value <= ramp.target) : (ramp.value >= ramp.target);
+    if (target_reached) {
+        ramp.value = ramp.target;
+        ramp.step = 0;
+    }
+
+    return int16_t(ramp.value >> 16);
+}
+
+static void cmd_envmixer(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    uint32_t address = get_address(state, w2);
+    size_t buffer_count = (flags & A_AUX) ? 4 : 2;
+    uint16_t count = state.count;
+    int16_t dry = state.dry;
+    int16_t wet = state.wet;
+
+    Ramp ramps[2];
+    int32_t exp_seq[2];
+    int32_t exp_rates[2];
+
+    // The envelope state saved between tasks, kept in the microcode's memory layout. Only the first
+    // envmixer_state_halfwords hold state, the rest of the microcode's 80 byte save area is left untouched.
+    int16_t save_buffer[envmixer_state_halfwords]{};
+
+    if (flags & A_INIT) {
+        for (size_t i = 0; i < 2; i++) {
+            ramps[i].value = int32_t(state.vol[i]) << 16;
+            ramps[i].target = int32_t(state.target[i]) << 16;
+            exp_rates[i] = state.rate[i];
+            exp_seq[i] = state.vol[i] * state.rate[i];
+        }
+    }
+    else {
+        memcpy(save_buffer, state.rdram + address, sizeof(save_buffer));
+        wet = save_buffer[0];
+        dry = save_buffer[2];
+        memcpy(&ramps[0].target, save_buffer + 4, sizeof(int32_t));
+        memcpy(&ramps[1].target, save_buffer + 6, sizeof(int32_t));
+        memcpy(&exp_rates[0], save_buffer + 8, sizeof(int32_t));
+        memcpy(&exp_rates[1], save_buffer + 10, sizeof(int32_t));
+        memcpy(&exp_seq[0], save_buffer + 12, sizeof(int32_t));
+        memcpy(&exp_seq[1], save_buffer + 14, sizeof(int32_t));
+        memcpy(&ramps[0].value, save_buffer + 16, sizeof(int32_t));
+        memcpy(&ramps[1].value, save_buffer + 18, sizeof(int32_t));
+    }
+
+    // The step is only zero once a ramp has reached its target.
+    for (size_t i = 0; i < 2; i++) {
+        ramps[i].step = ramps[i].target - ramps[i].value;
+    }
+
+    uint16_t buffers[4] = { state.out, state.dry_right, state.wet_left, state.wet_right };
+    bool contiguous = dmem_contiguous(state.in, count);
+    for (size_t i = 0; i < buffer_count; i++) {
+        contiguous &= dmem_contiguous(buffers[i], count);
+    }
+
+    uint16_t ptr = 0;
+    for (uint16_t y = 0; y < count; y += 16) {
+        for (size_t i = 0; i < 2; i++) {
+            if (ramps[i].step != 0) {
+                exp_seq[i] = int32_t((int64_t(exp_seq[i]) * int64_t(exp_rates[i])) >> 16);
+                ramps[i].step = (exp_seq[i] - ramps[i].value) >> 3;
+            }
+        }
+
+        // Gains for the dry left, dry right, wet left and wet right outputs, indexed by each sample's position in memory.
+        int16_t gains[4][8];
+        for (size_t x = 0; x < 8; x++) {
+            int32_t l_vol = ramp_step(ramps[0]);
+            int32_t r_vol = ramp_step(ramps[1]);
+            gains[0][x ^ 1] = clamp_s16((l_vol * dry + 0x4000) >> 15);
+            gains[1][x ^ 1] = clamp_s16((r_vol * dry + 0x4000) >> 15);
+            gains[2][x ^ 1] = clamp_s16((l_vol * wet + 0x4000) >> 15);
+            gains[3][x ^ 1] = clamp_s16((r_vol * wet + 0x4000) >> 15);
+        }
+
+#if defined(AUDIO_HLE_SIMD)
+        if (contiguous) {
+            uint16_t offset = ptr * 2;
+            // Load the input once, as it may alias one of the outputs.
+            __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.dmem + ((state.in + offset) & dmem_mask)));
+            for (size_t i = 0; i < buffer_count; i++) {
+                __m128i gain_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gains[i]));
+                mix8(reinterpret_cast<int16_t*>(state.dmem + ((buffers[i] + offset) & dmem_mask)), src, gain_vec);
+            }
+            ptr += 8;
+            continue;
+        }
+#endif
+
+        for (size_t x = 0; x < 8; x++, ptr++) {
+            int16_t src = dmem_sample(state, (state.in >> 1) + ptr);
+            for (size_t i = 0; i < buffer_count; i++) {
+                sample_mix(dmem_sample(state, (buffers[i] >> 1) + ptr), src, gains[i][x ^ 1]);
+            }
+        }
+    }
+
+    save_buffer[0] = wet;
+    save_buffer[2] = dry;
+    memcpy(save_buffer + 4, &ramps[0].target, sizeof(int32_t));
+    memcpy(save_buffer + 6, &ramps[1].target, sizeof(int32_t));
+    memcpy(save_buffer + 8, &exp_rates[0], sizeof(int32_t));
+    memcpy(save_buffer + 10, &exp_rates[1], sizeof(int32_t));
+    memcpy(save_buffer + 12, &exp_seq[0], sizeof(int32_t));
+    memcpy(save_buffer + 14, &exp_seq[1], sizeof(int32_t));
+    memcpy(save_buffer + 16, &ramps[0].value, sizeof(int32_t));
+    memcpy(save_buffer + 18, &ramps[1].value, sizeof(int32_t));
+    memcpy(state.rdram + address, save_buffer, sizeof(save_buffer));
+}
+
+static void cmd_mixer(AudioState& state, uint32_t w1, uint32_t w2) {
+    int16_t gain = int16_t(w1);
+    uint16_t dmemi = uint16_t(w2 >> 16) + dmem_base;
+    uint16_t dmemo = uint16_t(w2) + dmem_base;
+    if (state.count == 0) {
+        return;
+    }
+
+    uint16_t count = align(state.count, 32);
+    uint16_t i = 0;
+
+#if defined(AUDIO_HLE_SIMD)
+    if (dmem_contiguous(dmemi, count) && dmem_contiguous(dmemo, count)) {
+        int16_t* dst = reinterpret_cast<int16_t*>(state.dmem + (dmemo & dmem_mask));
+        const int16_t* src = reinterpret_cast<const int16_t*>(state.dmem + (dmemi & dmem_mask));
+        __m128i gain_vec = _mm_set1_epi16(gain);
+        for (; i + 16 <= count; i += 16) {
+            mix8(dst + i / 2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i / 2)), gain_vec);
+        }
+    }
+#endif
+
+    for (; i < count; i += 2) {
+        sample_mix(dmem_s16(state, dmemo + i), dmem_s16(state, dmemi + i), gain);
+    }
+}
+
+static void cmd_interleave(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint16_t left = uint16_t(w2 >> 16) + dmem_base;
+    uint16_t right = uint16_t(w2) + dmem_base;
+    if (state.count == 0) {
+        return;
+    }
+
+    // Each channel holds count bytes, producing twice that in the output.
+    uint16_t count = align(state.count, 16) / 2;
+    uint16_t out = state.out;
+    for (uint16_t i = 0; i < count; i++, out += 4) {
+        int16_t l = dmem_s16(state, left + 2 * i);
+        int16_t r = dmem_s16(state, right + 2 * i);
+        dmem_s16(state, out + 0) = l;
+        dmem_s16(state, out + 2) = r;
+    }
+}
+
+static void cmd_polef(AudioState& state, uint32_t w1, uint32_t w2) {
+    uint8_t flags = uint8_t(w1 >> 16);
+    int16_t gain = int16_t(w1);
+    uint32_t address = get_address(state, w2);
+    if (state.count == 0) {
+        return;
+    }
+
+    uint16_t dmemi = state.in;
+    uint16_t dmemo = state.out;
+    uint16_t count = align(state.count, 16);
+    const int16_t* h1 = state.adpcm_table;
+    int16_t h2[8];
+    int16_t h2_before[8];
+    int16_t l1 = 0;
+    int16_t l2 = 0;
+
+    if (!(flags & A_INIT)) {
+        l1 = int16_t(rdram_u16(state, address + 4));
+        l2 = int16_t(rdram_u16(state, address + 6));
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        h2_before[i] = state.adpcm_table[8 + i];
+        h2[i] = int16_t((int32_t(h2_before[i]) * gain) >> 14);
+    }
+    // The microcode leaves the scaled coefficients in its copy of the table.
+    std::copy(std::begin(h2), std::end(h2), state.adpcm_table + 8);
+
+    int16_t frame_out[8] = {};
+    while (count != 0) {
+        int16_t frame[8];
+        for (size_t i = 0; i < 8; i++, dmemi += 2) {
+            frame[i] = dmem_s16(state, dmemi);
+        }
+
+        for (size_t i = 0; i < 8; i++) {
+            int32_t accum = frame[i] * gain;
+            accum += h1[i] * l1 + h2_before[i] * l2;
+            for (size_t j = 0; j < i; j++) {
+                accum += h2[j] * frame[i - 1 - j];
+            }
+            frame_out[i] = clamp_s16(accum >> 14);
+            dmem_s16(state, dmemo + 2 * i) = frame_out[i];
+        }
+
+        l1 = frame_out[6];
+        l2 = frame_out[7];
+        dmemo += 16;
+        count -= 16;
+    }
+
+    rdram_store_u16(state, frame_out + 4, address, 4);
+}
+
+static void cmd_noop(AudioState& state, uint32_t w1, uint32_t w2) {}
+
+using CommandFunc = void(AudioState& state, uint32_t w1, uint32_t w2);
+
+static CommandFunc* const commands[num_opcodes] = {
+    cmd_noop,     cmd_adpcm,      cmd_clearbuff, cmd_envmixer,
+    cmd_loadbuff, cmd_resample,   cmd_savebuff,  cmd_segment,
+    cmd_setbuff,  cmd_setvol,     cmd_dmemmove,  cmd_loadadpcm,
+    cmd_mixer,    cmd_interleave, cmd_polef,     cmd_setloop,
+};
+
+// Finds the resampler's filter table in the microcode data loaded into DMEM. Returns nullptr if it isn't there,
+// which means the task uses a different microcode than the one this implementation is based on.
+static const int16_t* find_resample_table(const uint8_t* dmem) {
+    const uint16_t* halfwords = reinterpret_cast<const uint16_t*>(dmem);
+    constexpr size_t table_halfwords = resample_table_rows * 4;
+    constexpr size_t search_end = dmem_task_offset / 2 - table_halfwords;
+
+    // The table rows have to be contiguous in host memory, so only word aligned locations where the word layout
+    // keeps consecutive halfwords in order (after swapping pairs) can be used. Search for the swapped pattern.
+    for (size_t i = 0; i + 4 <= search_end; i += 2) {
+        if (halfwords[i + 1] == resample_table_signature[0] && halfwords[i + 0] == resample_table_signature[1] &&
+            halfwords[i + 3] == resample_table_signature[2] && halfwords[i + 2] == resample_table_signature[3]) {
+            return reinterpret_cast<const int16_t*>(halfwords + i);
+        }
+    }
+    return nullptr;
+}
+
+bool zelda64::audio_hle::mode_from_string(std::string_view name, Mode& mode_out) {
+    if (name == "recompiled") {
+        mode_out = Mode::Recompiled;
+        return true;
+    }
+    if (name == "native") {
+        mode_out = Mode::Native;
+        return true;
+    }
+    if (name == "verify") {
+        mode_out = Mode::Verify;
+        return true;
+    }
+    return false;
+}
+
+static void get_command_list(const uint8_t* dmem, uint32_t& address_out, uint32_t& size_out) {
+    OSTask task;
+    memcpy(&task, dmem + dmem_task_offset, sizeof(task));
+
+    address_out = uint32_t(task.t.data_ptr) & rdram_mask;
+    size_out = uint32_t(task.t.data_size) & ~7u;
+}
+
+bool zelda64::audio_hle::can_run_task(const uint8_t* rdram, const uint8_t* dmem) {
+    uint32_t list_address;
+    uint32_t list_size;
+    get_command_list(dmem, list_address, list_size);
+
+    if (find_resample_table(dmem) == nullptr) {
+        return false;
+    }
+    for (uint32_t offset = 0; offset < list_size; offset += 8) {
+        uint32_t w1;
+        memcpy(&w1, rdram + ((list_address + offset) & rdram_mask), sizeof(w1));
+        if (((w1 >> 24) & 0x7F) >= num_opcodes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool zelda64::audio_hle::run_task(uint8_t* rdram, uint8_t* dmem) {
+    // Check everything that could make the task unsupported before modifying any memory.
+    if (!can_run_task(rdram, dmem)) {
+        return false;
+    }
+
+    uint32_t list_address;
+    uint32_t list_size;
+    get_command_list(dmem, list_address, list_size);
+    const int16_t* table_words = find_resample_table(dmem);
+
+    AudioState state{};
+    state.rdram = rdram;
+    state.dmem = dmem;
+
+    // The table is stored with each pair of halfwords swapped, so unswap it once for the resampler.
+    for (size_t i = 0; i < std::size(state.resample_table); i++) {
+        state.resample_table[i] = table_words[i ^ 1];
+    }
+
+    for (uint32_t offset = 0; offset < list_size; offset += 8) {
+        uint32_t w1;
+        uint32_t w2;
+        memcpy(&w1, rdram + ((list_address + offset) & rdram_mask), sizeof(w1));
+        memcpy(&w2, rdram + ((list_address + offset + 4) & rdram_mask), sizeof(w2));
+        commands[(w1 >> 24) & 0x7F](state, w1, w2);
+    }
+
+    return true;
+}
+
+// Verification state. Audio tasks always run on the same thread, so this doesn't need synchronization.
+// Covers the patches' extra RAM above the game's 8MB too, as the music driver's sample data is served from there.
+constexpr size_t verify_rdram_size = size_t{rdram_mask} + 1;
+constexpr uint32_t verify_block_size = 64;
+// Region of DMEM that holds the buffers addressed by the command list.
+constexpr uint32_t verify_dmem_start = dmem_base;
+constexpr uint32_t verify_dmem_end = 0xF80;
+
+struct VerifyState {
+    std::unique_ptr<uint8_t[]> rdram_before;
+    // Covers the whole 24-bit address range that the native implementation can access.
+    std::unique_ptr<uint8_t[]> rdram_native;
+    uint8_t dmem_native[0x1000];
+    bool native_ran;
+    uint64_t task_count;
+    uint64_t unsupported_count;
+    uint64_t rdram_mismatch_count;
+    uint64_t dmem_mismatch_count;
+};
+
+static VerifyState verify_state{};
+
+void zelda64::audio_hle::begin_verify(uint8_t* rdram) {
+    if (!verify_state.rdram_before) {
+        verify_state.rdram_before = std::make_unique<uint8_t[]>(verify_rdram_size);
+        verify_state.rdram_native = std::make_unique<uint8_t[]>(rdram_mask + 1);
+    }
+
+    // Run the native implementation against private copies, so the game only ever sees the recompiled microcode's results.
+    memcpy(verify_state.rdram_before.get(), rdram, verify_rdram_size);
+    memcpy(verify_state.rdram_native.get(), rdram, verify_rdram_size);
+    memcpy(verify_state.dmem_native, dmem, sizeof(verify_state.dmem_native));
+    verify_state.native_ran = run_task(verify_state.rdram_native.get(), verify_state.dmem_native);
+}
+
+void zelda64::audio_hle::end_verify(uint8_t* rdram) {
+    uint64_t task_index = verify_state.task_count++;
+    if (!verify_state.native_ran) {
+        verify_state.unsupported_count++;
+        return;
+    }
+
+    const uint8_t* before = verify_state.rdram_before.get();
+    const uint8_t* native = verify_state.rdram_native.get();
+
+    // Only compare blocks that either implementation wrote to. The game's CPU keeps running during the task, so a CPU
+    // write that lands in a block the microcode also writes can show up as a false mismatch.
+    bool rdram_matches = true;
+    uint32_t first_mismatch = 0;
+    for (uint32_t block = 0; block < verify_rdram_size; block += verify_block_size) {
+        bool native_wrote = memcmp(native + block, before + block, verify_block_size) != 0;
+        bool recompiled_wrote = memcmp(rdram + block, before + block, verify_block_size) != 0;
+        if ((native_wrote || recompiled_wrote) && memcmp(native + block, rdram + block, verify_block_size) != 0) {
+            rdram_matches = false;
+            first_mismatch = block;
+            break;
+        }
+    }
+
+    bool dmem_matches = memcmp(verify_state.dmem_native + verify_dmem_start, dmem + verify_dmem_start, verify_dmem_end - verify_dmem_start) == 0;
+
+    if (!rdram_matches) {
+        if (verify_state.rdram_mismatch_count < 16) {
+            fprintf(stderr, "Audio task %llu: native RDRAM output differs from the recompiled microcode near 0x%06X\n",
+                (unsigned long long)task_index, first_mismatch);
+        }
+        verify_state.rdram_mismatch_count++;
+    }
+    if (!dmem_matches) {
+        verify_state.dmem_mismatch_count++;
+    }
+}
+
+void zelda64::audio_hle::print_verify_summary() {
+    if (verify_state.task_count == 0) {
+        return;
+    }
+
+    printf("Audio microcode verification: %llu tasks, %llu unsupported, %llu RDRAM mismatches, %llu DMEM mismatches\n",
+        (unsigned long long)verify_state.task_count, (unsigned long long)verify_state.unsupported_count,
+        (unsigned long long)verify_state.rdram_mismatch_count, (unsigned long long)verify_state.dmem_mismatch_count);
+}
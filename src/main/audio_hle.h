@@ -0,0 +1,69 @@
+#ifndef __AUDIO_HLE_H__
+#define __AUDIO_HLE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include "librecomp/rsp.hpp"
+
+// Native implementation of the audio microcode's command list (libultra's ABI 1: ADPCM, RESAMPLE, ENVMIXER, MIXER,
+// INTERLEAVE, POLEF and the buffer management commands). Runs the same work as the recompiled aspMain without emulating
+// the RSP's vector unit.
+namespace zelda64 {
+    namespace audio_hle {
+        enum class Mode {
+            // Always run the recompiled microcode.
+            Recompiled,
+            // Run the native implementation, falling back to the recompiled microcode for tasks it can't handle.
+            Native,
+            // Run both on every task and report differences. The recompiled microcode's results are the ones kept.
+            Verify,
+        };
+
+        // Parses a mode name as given in the RECOMP_AUDIO_UCODE environment variable. Returns false for unknown names.
+        bool mode_from_string(std::string_view name, Mode& mode_out);
+
+        // Runs the audio task that the runtime has loaded into `dmem` natively. Returns false without modifying
+        // any memory if the task uses something that the native implementation doesn't support.
+        bool run_task(uint8_t* rdram, uint8_t* dmem);
+        // Returns whether run_task would be able to run the task loaded into `dmem`.
+        bool can_run_task(const uint8_t* rdram, const uint8_t* dmem);
+
+        void begin_verify(uint8_t* rdram);
+        void end_verify(uint8_t* rdram);
+        // Prints the number of verified and mismatching tasks.
+        void print_verify_summary();
+
+        // Adapts the native implementation to the runtime's microcode signature, which differs between runtime versions.
+        template <typename Sig>
+        struct UcodeAdapter;
+
+        template <typename... Args>
+        struct UcodeAdapter<RspExitReason(uint8_t*, Args...)> {
+            template <RspUcodeFunc* Fallback>
+            static RspExitReason run_native(uint8_t* rdram, Args... args) {
+                if (run_task(rdram, dmem)) {
+                    return RspExitReason::Broke;
+                }
+                return Fallback(rdram, args...);
+            }
+
+            template <RspUcodeFunc* Reference>
+            static RspExitReason run_verify(uint8_t* rdram, Args... args) {
+                begin_verify(rdram);
+                RspExitReason ret = Reference(rdram, args...);
+                end_verify(rdram);
+                return ret;
+            }
+        };
+
+        template <RspUcodeFunc* Fallback>
+        constexpr RspUcodeFunc* native_ucode = &UcodeAdapter<RspUcodeFunc>::template run_native<Fallback>;
+
+        template <RspUcodeFunc* Reference>
+        constexpr RspUcodeFunc* verifying_ucode = &UcodeAdapter<RspUcodeFunc>::template run_verify<Reference>;
+    }
+}
+
+#endif
@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <cmath>
+
+#include "audio_queue_clock.h"
+
+// Weight of a device measurement when correcting the model. Devices consume audio one period at a time, so a single
+// measurement can be off by up to a period in either direction. Partial correction averages that out.
+constexpr double resync_weight = 0.2;
+// Errors larger than this many seconds of audio aren't period jitter but a real discontinuity, such as an underrun
+// or the device being stalled, so the model is snapped to the measurement instead.
+constexpr double resync_snap_seconds = 0.05;
+
+void zelda64::audio::QueueClock::reset(uint32_t new_output_rate, clock::time_point now) {
+    output_rate = new_output_rate;
+    queued_frames = 0.0;
+    last_update = now;
+    last_resync = now;
+    has_resynced = false;
+}
+
+void zelda64::audio::QueueClock::advance(clock::time_point now) {
+    double elapsed_seconds = std::chrono::duration<double>(now - last_update).count();
+    if (elapsed_seconds > 0.0) {
+        queued_frames = std::max(0.0, queued_frames - elapsed_seconds * output_rate);
+        last_update = now;
+    }
+}
+
+void zelda64::audio::QueueClock::add_frames(size_t frame_count, clock::time_point now) {
+    advance(now);
+    queued_frames += double(frame_count);
+}
+
+void zelda64::audio::QueueClock::resync(size_t measured_frames, clock::time_point now) {
+    advance(now);
+
+    double error = double(measured_frames) - queued_frames;
+    if (!has_resynced || std::abs(error) > resync_snap_seconds * output_rate) {
+        queued_frames = double(measured_frames);
+    }
+    else {
+        queued_frames += error * resync_weight;
+    }
+
+    last_resync = now;
+    has_resynced = true;
+}
+
+double zelda64::audio::QueueClock::predict(clock::time_point now) const {
+    double elapsed_seconds = std::max(0.0, std::chrono::duration<double>(now - last_update).count());
+    return std::max(0.0, queued_frames - elapsed_seconds * output_rate);
+}
@@ -0,0 +1,43 @@
+#ifndef __AUDIO_QUEUE_CLOCK_H__
+#define __AUDIO_QUEUE_CLOCK_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+namespace zelda64 {
+    namespace audio {
+        // Model of the output queue's fill level. Tracks the frames submitted to the backend and drains them at the
+        // output rate using a monotonic clock, so that the fill level can be predicted without querying the device.
+        // The model is corrected towards the device's own count whenever one is available.
+        class QueueClock {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            // How long predictions are trusted before the model asks the device for its count again.
+            static constexpr auto resync_interval = std::chrono::milliseconds(250);
+
+            void reset(uint32_t output_rate, clock::time_point now);
+            // Records frames that were just submitted to the backend.
+            void add_frames(size_t frame_count, clock::time_point now);
+            // Corrects the model with a count of queued frames measured on the device.
+            void resync(size_t measured_frames, clock::time_point now);
+            // Predicted number of frames still queued.
+            double predict(clock::time_point now) const;
+            // True if the last resync is older than resync_interval.
+            bool needs_resync(clock::time_point now) const { return now - last_resync >= resync_interval; }
+
+        private:
+            uint32_t output_rate = 0;
+            // Queued frames as of last_update.
+            double queued_frames = 0.0;
+            clock::time_point last_update;
+            clock::time_point last_resync;
+            bool has_resynced = false;
+
+            void advance(clock::time_point now);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <cmath>
+
+#include "audio_rate_control.h"
+
+// Weight of the newest queue measurement in the smoothed fill level.
+constexpr double smoothing_factor = 0.1;
+
+void zelda64::audio::RateController::set_target_frames(size_t frames) {
+    target_frames = std::max(frames, size_t{1});
+}
+
+double zelda64::audio::RateController::update(size_t queued_frames) {
+    if (!has_sample) {
+        smoothed_frames = double(queued_frames);
+        has_sample = true;
+    }
+    else {
+        smoothed_frames += (double(queued_frames) - smoothed_frames) * smoothing_factor;
+    }
+
+    // Proportional control on the relative error, saturating once the fill is off by the full target in either direction.
+    double error = (smoothed_frames - double(target_frames)) / double(target_frames);
+    saturated = std::abs(error) >= 1.0;
+    error = std::clamp(error, -1.0, 1.0);
+
+    return 1.0 + error * max_adjustment;
+}
+
+bool zelda64::audio::RateController::is_overflowing(size_t queued_frames) const {
+    // Allow several times the target before giving up on smooth correction, as that only happens after a long stall.
+    // Stay clear of the output's capacity though, since the output drops whatever doesn't fit without reporting it.
+    size_t threshold = std::min(target_frames * 8, capacity_frames / 4 * 3);
+    return queued_frames > threshold;
+}
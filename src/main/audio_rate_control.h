@@ -0,0 +1,42 @@
+#ifndef __AUDIO_RATE_CONTROL_H__
+#define __AUDIO_RATE_CONTROL_H__
+
+#include <cstdint>
+#include <cstddef>
+
+namespace zelda64 {
+    namespace audio {
+        // Dynamic rate control. Nudges the resampling ratio by a fraction of a percent to keep the amount of queued
+        // audio around a target, instead of skipping samples once too much audio has built up.
+        class RateController {
+        public:
+            // Largest deviation from the nominal rate that the controller applies. 0.5% is below what's audible as a pitch change.
+            static constexpr double max_adjustment = 0.005;
+
+            void set_target_frames(size_t frames);
+            size_t get_target_frames() const { return target_frames; }
+            // Sets the number of frames the output can hold, which keeps is_overflowing from waiting for the output to
+            // start dropping frames itself.
+            void set_capacity_frames(size_t frames) { capacity_frames = frames; }
+
+            // Updates the controller with the number of frames currently queued at the output and returns the factor to
+            // apply to the resampler step. Values above 1 consume input faster, which drains the queue.
+            double update(size_t queued_frames);
+
+            // True if the queue is so far above the target that the controller can't catch up in a reasonable time.
+            bool is_overflowing(size_t queued_frames) const;
+            // True if the last update applied the largest adjustment, meaning the queue is far from the target.
+            bool is_saturated() const { return saturated; }
+
+        private:
+            size_t target_frames = 0;
+            size_t capacity_frames = SIZE_MAX;
+            // Smoothed queue fill, which filters out the steps caused by the device consuming audio one period at a time.
+            double smoothed_frames = 0.0;
+            bool has_sample = false;
+            bool saturated = false;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "audio_resampler.h"
+
+zelda64::audio::Resampler::Resampler() :
+    mode{ResamplerMode::Sinc}, input_rate{48000}, output_rate{48000}, half_taps{}, step{1.0}, position{}, history_frames{} {
+    rebuild();
+}
+
+void zelda64::audio::Resampler::set_rates(uint32_t new_input_rate, uint32_t new_output_rate) {
+    if (new_input_rate == input_rate && new_output_rate == output_rate) {
+        return;
+    }
+
+    input_rate = new_input_rate;
+    output_rate = new_output_rate;
+
+    // Keep the buffered history so that the stream stays continuous across a rate change, only the step and filter need updating.
+    step = double(input_rate) / double(output_rate);
+    if (mode == ResamplerMode::Sinc) {
+        build_sinc_table();
+    }
+}
+
+void zelda64::audio::Resampler::set_mode(ResamplerMode new_mode) {
+    if (new_mode == mode) {
+        return;
+    }
+
+    mode = new_mode;
+    rebuild();
+}
+
+void zelda64::audio::Resampler::reset() {
+    rebuild();
+}
+
+void zelda64::audio::Resampler::rebuild() {
+    half_taps = (mode == ResamplerMode::Linear) ? 1 : sinc_half_taps;
+    step = double(input_rate) / double(output_rate);
+
+    // Start with enough silent history that the first output frame is centered on the first input frame.
+    history_frames = half_taps - 1;
+    position = double(half_taps - 1);
+    buffer.assign(history_frames * channels, 0.0f);
+
+    if (mode == ResamplerMode::Sinc) {
+        build_sinc_table();
+    }
+    else {
+        sinc_table.clear();
+    }
+}
+
+void zelda64::audio::Resampler::build_sinc_table() {
+    constexpr double pi = 3.14159265358979323846;
+    constexpr uint32_t taps = 2 * sinc_half_taps;
+
+    // Lower the cutoff when downsampling to prevent aliasing.
+    double cutoff = std::min(1.0, double(output_rate) / double(input_rate));
+
+    sinc_table.resize((sinc_phases + 1) * taps);
+
+    for (uint32_t phase = 0; phase <= sinc_phases; phase++) {
+        double frac = double(phase) / sinc_phases;
+        float* row = &sinc_table[phase * taps];
+        double sum = 0.0;
+
+        for (uint32_t tap = 0; tap < taps; tap++) {
+            // Distance between this tap's input frame and the interpolated position.
+            double distance = double(int32_t(tap) + 1 - int32_t(sinc_half_taps)) - frac;
+            double x = cutoff * distance;
+            double sinc = (std::abs(x) < 1e-9) ? 1.0 : std::sin(pi * x) / (pi * x);
+
+            // Blackman window over the width of the filter.
+            double window_pos = distance / sinc_half_taps;
+            double window = 0.0;
+            if (std::abs(window_pos) < 1.0) {
+                window = 0.42 + 0.5 * std::cos(pi * window_pos) + 0.08 * std::cos(2.0 * pi * window_pos);
+            }
+
+            double coefficient = cutoff * sinc * window;
+            row[tap] = float(coefficient);
+            sum += coefficient;
+        }
+
+        // Normalize each phase to unity gain to avoid a DC ripple that depends on the interpolation position.
+        for (uint32_t tap = 0; tap < taps; tap++) {
+            row[tap] = float(row[tap] / sum);
+        }
+    }
+}
+
+float* zelda64::audio::Resampler::get_input_buffer(size_t frame_count) {
+    size_t required_size = (history_frames + frame_count) * channels;
+    if (buffer.size() < required_size) {
+        buffer.resize(required_size);
+    }
+
+    return buffer.data() + history_frames * channels;
+}
+
+size_t zelda64::audio::Resampler::max_output_frames(size_t frame_count, double rate_adjust) const {
+    // Add a couple of frames to account for rounding in the position.
+    return size_t(double(history_frames + frame_count) / (step * rate_adjust)) + 2;
+}
+
+size_t zelda64::audio::Resampler::process(size_t frame_count, float* output, size_t output_capacity, double rate_adjust) {
+    const size_t total_frames = history_frames + frame_count;
+    const double cur_step = step * rate_adjust;
+    const float* input = buffer.data();
+    size_t output_frames = 0;
+
+    if (mode == ResamplerMode::Linear) {
+        while (output_frames < output_capacity) {
+            size_t index = size_t(position);
+            if (index + 1 >= total_frames) {
+                break;
+            }
+
+            float frac = float(position - double(index));
+            const float* cur = &input[index * channels];
+            output[output_frames * channels + 0] = cur[0] + (cur[channels + 0] - cur[0]) * frac;
+            output[output_frames * channels + 1] = cur[1] + (cur[channels + 1] - cur[1]) * frac;
+
+            output_frames++;
+            position += cur_step;
+        }
+    }
+    else {
+        constexpr uint32_t taps = 2 * sinc_half_taps;
+        while (output_frames < output_capacity) {
+            size_t index = size_t(position);
+            if (index + sinc_half_taps >= total_frames) {
+                break;
+            }
+
+            double frac = position - double(index);
+            const float* coefficients = &sinc_table[size_t(frac * sinc_phases + 0.5) * taps];
+            const float* cur = &input[(index + 1 - sinc_half_taps) * channels];
+
+            float left = 0.0f;
+            float right = 0.0f;
+            for (uint32_t tap = 0; tap < taps; tap++) {
+                left += coefficients[tap] * cur[tap * channels + 0];
+                right += coefficients[tap] * cur[tap * channels + 1];
+            }
+            output[output_frames * channels + 0] = left;
+            output[output_frames * channels + 1] = right;
+
+            output_frames++;
+            position += cur_step;
+        }
+    }
+
+    // Keep only the frames that the filter still needs for the next chunk and rebase the position onto them.
+    // When downsampling the position can run past the end of the buffer, in which case everything is consumed
+    // and the remaining offset carries over to the next chunk.
+    size_t first_needed = std::min(size_t(position) + 1 - half_taps, total_frames);
+    history_frames = total_frames - first_needed;
+    position -= double(first_needed);
+    if (first_needed != 0 && history_frames != 0) {
+        std::memmove(buffer.data(), buffer.data() + first_needed * channels, history_frames * channels * sizeof(float));
+    }
+
+    return output_frames;
+}
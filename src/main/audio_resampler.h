@@ -0,0 +1,63 @@
+#ifndef __AUDIO_RESAMPLER_H__
+#define __AUDIO_RESAMPLER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "zelda_sound.h"
+
+namespace zelda64 {
+    namespace audio {
+        // Streaming stereo resampler that keeps its filter history between chunks, so consecutive chunks are
+        // resampled as one continuous signal without needing to duplicate frames across chunk boundaries.
+        // Terminology matches main.cpp: a frame is one sample for each channel.
+        class Resampler {
+        public:
+            static constexpr uint32_t channels = 2;
+            // Half the number of taps used by the windowed-sinc filter.
+            static constexpr uint32_t sinc_half_taps = 8;
+            // Number of precomputed filter phases between two input frames.
+            static constexpr uint32_t sinc_phases = 256;
+
+            Resampler();
+
+            void set_rates(uint32_t input_rate, uint32_t output_rate);
+            void set_mode(ResamplerMode mode);
+            ResamplerMode get_mode() const { return mode; }
+            // Drops all buffered history, e.g. after the output device was reset.
+            void reset();
+
+            // Returns a pointer that the caller should write `frame_count` interleaved input frames to.
+            // The returned memory is owned by the resampler and stays valid until the next call to `process`.
+            float* get_input_buffer(size_t frame_count);
+            // Upper bound of the number of output frames that `process` can produce for the given input frame count.
+            size_t max_output_frames(size_t frame_count, double rate_adjust = 1.0) const;
+            // Resamples the `frame_count` frames previously written to the input buffer straight into `output`.
+            // `rate_adjust` scales the input step, which allows callers to slightly speed up or slow down playback.
+            // Returns the number of output frames written.
+            size_t process(size_t frame_count, float* output, size_t output_capacity, double rate_adjust = 1.0);
+
+        private:
+            ResamplerMode mode;
+            uint32_t input_rate;
+            uint32_t output_rate;
+            // Number of input frames that the filter reads before and after the interpolated position.
+            uint32_t half_taps;
+            // Input frames advanced per output frame.
+            double step;
+            // Interpolation position in input frames, relative to the start of the buffer.
+            double position;
+            // Number of frames of filter history at the start of the buffer.
+            size_t history_frames;
+            std::vector<float> buffer;
+            // Sinc filter coefficients, laid out as `sinc_phases + 1` rows of `2 * sinc_half_taps` taps.
+            std::vector<float> sinc_table;
+
+            void rebuild();
+            void build_sinc_table();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <cmath>
+#include <cstdio>
+
+#include "zelda_audio_stats.h"
+
+using zelda64::Histogram;
+using zelda64::stats_histogram_buckets;
+
+struct AudioStats {
+    std::atomic<uint64_t> chunks_queued{};
+    std::atomic<uint64_t> chunks_dropped{};
+    std::atomic<uint64_t> rate_saturated{};
+    std::atomic<uint64_t> device_underruns{};
+    Histogram queued_us;
+    Histogram rate_adjust_ppm;
+    Histogram convert_ns;
+    Histogram frames_remaining;
+};
+
+static AudioStats audio_stats{};
+
+void zelda64::audio::record_queued_chunk(uint64_t queued_us, double rate_adjust, bool rate_saturated) {
+    audio_stats.chunks_queued.fetch_add(1, std::memory_order_relaxed);
+    audio_stats.queued_us.record(queued_us);
+    audio_stats.rate_adjust_ppm.record(uint64_t(std::abs(rate_adjust - 1.0) * 1e6 + 0.5));
+    if (rate_saturated) {
+        audio_stats.rate_saturated.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void zelda64::audio::record_dropped_chunk() {
+    audio_stats.chunks_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void zelda64::audio::record_device_underrun() {
+    audio_stats.device_underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void zelda64::audio::record_convert_time(uint64_t nanoseconds) {
+    audio_stats.convert_ns.record(nanoseconds);
+}
+
+void zelda64::audio::record_frames_remaining(uint64_t frames) {
+    audio_stats.frames_remaining.record(frames);
+}
+
+zelda64::audio::StatsSnapshot zelda64::audio::get_stats() {
+    StatsSnapshot ret{};
+    ret.chunks_queued = audio_stats.chunks_queued.load(std::memory_order_relaxed);
+    ret.chunks_dropped = audio_stats.chunks_dropped.load(std::memory_order_relaxed);
+    ret.rate_saturated = audio_stats.rate_saturated.load(std::memory_order_relaxed);
+    ret.device_underruns = audio_stats.device_underruns.load(std::memory_order_relaxed);
+    ret.queued_us = audio_stats.queued_us.snapshot();
+    ret.rate_adjust_ppm = audio_stats.rate_adjust_ppm.snapshot();
+    ret.convert_ns = audio_stats.convert_ns.snapshot();
+    ret.frames_remaining = audio_stats.frames_remaining.snapshot();
+    return ret;
+}
+
+void zelda64::audio::reset_stats() {
+    audio_stats.chunks_queued.store(0, std::memory_order_relaxed);
+    audio_stats.chunks_dropped.store(0, std::memory_order_relaxed);
+    audio_stats.rate_saturated.store(0, std::memory_order_relaxed);
+    audio_stats.device_underruns.store(0, std::memory_order_relaxed);
+    audio_stats.queued_us.reset();
+    audio_stats.rate_adjust_ppm.reset();
+    audio_stats.convert_ns.reset();
+    audio_stats.frames_remaining.reset();
+}
+
+static std::string format_counter(const char* name, uint64_t value) {
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %llu", name, (unsigned long long)value);
+    return line;
+}
+
+std::vector<std::string> zelda64::audio::format_stats(const StatsSnapshot& stats) {
+    return {
+        format_counter("Chunks queued", stats.chunks_queued),
+        format_counter("Chunks dropped", stats.chunks_dropped),
+        format_counter("Rate control saturated", stats.rate_saturated),
+        format_counter("Device underruns", stats.device_underruns),
+        zelda64::format_histogram("Queued audio (us)", stats.queued_us),
+        zelda64::format_histogram("Rate adjustment (ppm)", stats.rate_adjust_ppm),
+        zelda64::format_histogram("Conversion time (ns)", stats.convert_ns),
+        zelda64::format_histogram("Frames remaining", stats.frames_remaining),
+    };
+}
+
+static void dump_histogram(FILE* file, const char* name, const zelda64::audio::HistogramSnapshot& histogram) {
+    fprintf(file, "\n%s\n", name);
+    for (size_t i = 0; i < stats_histogram_buckets; i++) {
+        if (histogram.buckets[i] == 0) {
+            continue;
+        }
+        uint64_t low = zelda64::HistogramSnapshot::bucket_low(i);
+        uint64_t high = zelda64::HistogramSnapshot::bucket_high(i);
+        fprintf(file, "  [%llu, %llu]: %llu\n", (unsigned long long)low, (unsigned long long)high, (unsigned long long)histogram.buckets[i]);
+    }
+}
+
+bool zelda64::audio::dump_stats(const std::filesystem::path& path) {
+    StatsSnapshot stats = get_stats();
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    file = _wfopen(path.c_str(), L"w");
+#else
+    file = fopen(path.c_str(), "w");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    for (const std::string& line : format_stats(stats)) {
+        fprintf(file, "%s\n", line.c_str());
+    }
+
+    dump_histogram(file, "Queued audio (us)", stats.queued_us);
+    dump_histogram(file, "Rate adjustment (ppm)", stats.rate_adjust_ppm);
+    dump_histogram(file, "Conversion time (ns)", stats.convert_ns);
+    dump_histogram(file, "Frames remaining", stats.frames_remaining);
+
+    return fclose(file) == 0;
+}
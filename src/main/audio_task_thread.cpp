@@ -0,0 +1,130 @@
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "audio_task_thread.h"
+#include "audio_hle.h"
+
+constexpr size_t task_dmem_size = 0x1000;
+
+struct TaskThreadState {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable task_cv;
+    std::condition_variable done_cv;
+    bool running = false;
+    bool stop_requested = false;
+    bool task_pending = false;
+    uint8_t* rdram = nullptr;
+    // Private copy of the task's DMEM, as the runtime reuses the shared one for the next task.
+    alignas(16) uint8_t dmem[task_dmem_size];
+};
+
+static TaskThreadState task_thread_state{};
+
+// Keeps the task thread on the last core, which the OS is least likely to schedule the game's busiest threads on.
+static void pin_to_last_core(std::thread& thread) {
+    unsigned int core_count = std::thread::hardware_concurrency();
+    if (core_count < 2) {
+        return;
+    }
+    unsigned int core = core_count - 1;
+
+#ifdef _WIN32
+    if (core < sizeof(DWORD_PTR) * 8) {
+        SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{1} << core);
+    }
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core, &cpu_set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+#else
+    // macOS doesn't support pinning threads to cores.
+    (void)core;
+#endif
+}
+
+static void task_thread_func() {
+    std::unique_lock lock{ task_thread_state.mutex };
+    while (true) {
+        task_thread_state.task_cv.wait(lock, []() { return task_thread_state.task_pending || task_thread_state.stop_requested; });
+        if (task_thread_state.stop_requested) {
+            return;
+        }
+
+        // Nothing else touches the task while it's pending, so run it without holding the lock.
+        lock.unlock();
+        zelda64::audio_hle::run_task(task_thread_state.rdram, task_thread_state.dmem);
+        lock.lock();
+
+        task_thread_state.task_pending = false;
+        task_thread_state.done_cv.notify_all();
+    }
+}
+
+void zelda64::audio_hle::start_task_thread() {
+    if (task_thread_state.running) {
+        return;
+    }
+
+    task_thread_state.stop_requested = false;
+    task_thread_state.task_pending = false;
+    task_thread_state.thread = std::thread{ task_thread_func };
+    pin_to_last_core(task_thread_state.thread);
+    task_thread_state.running = true;
+}
+
+void zelda64::audio_hle::stop_task_thread() {
+    if (!task_thread_state.running) {
+        return;
+    }
+
+    wait_for_task();
+    {
+        std::lock_guard lock{ task_thread_state.mutex };
+        task_thread_state.stop_requested = true;
+    }
+    task_thread_state.task_cv.notify_one();
+    task_thread_state.thread.join();
+    task_thread_state.running = false;
+}
+
+bool zelda64::audio_hle::task_thread_running() {
+    return task_thread_state.running;
+}
+
+bool zelda64::audio_hle::submit_task(uint8_t* rdram, const uint8_t* dmem) {
+    // The previous task may still be writing state that this one reads, such as the envelope and resampler history.
+    wait_for_task();
+
+    if (!can_run_task(rdram, dmem)) {
+        return false;
+    }
+
+    {
+        std::lock_guard lock{ task_thread_state.mutex };
+        task_thread_state.rdram = rdram;
+        memcpy(task_thread_state.dmem, dmem, task_dmem_size);
+        task_thread_state.task_pending = true;
+    }
+    task_thread_state.task_cv.notify_one();
+    return true;
+}
+
+void zelda64::audio_hle::wait_for_task() {
+    if (!task_thread_state.running) {
+        return;
+    }
+
+    std::unique_lock lock{ task_thread_state.mutex };
+    task_thread_state.done_cv.wait(lock, []() { return !task_thread_state.task_pending; });
+}
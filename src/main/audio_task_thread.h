@@ -0,0 +1,42 @@
+#ifndef __AUDIO_TASK_THREAD_H__
+#define __AUDIO_TASK_THREAD_H__
+
+#include <cstdint>
+
+#include "librecomp/rsp.hpp"
+
+// Runs audio tasks on a dedicated thread with the native microcode implementation. The task is reported as complete to
+// the game as soon as it has been handed off, and its output is waited for right before the game's audio is consumed.
+// This lets the audio work overlap with the game's other threads.
+namespace zelda64 {
+    namespace audio_hle {
+        void start_task_thread();
+        void stop_task_thread();
+        bool task_thread_running();
+
+        // Hands the task that the runtime has loaded into `dmem` to the task thread. Returns false if the native
+        // implementation can't run it, in which case nothing is queued.
+        bool submit_task(uint8_t* rdram, const uint8_t* dmem);
+        // Blocks until the last submitted task has finished. Must be called before reading anything that task writes.
+        void wait_for_task();
+
+        template <typename Sig>
+        struct AsyncAdapter;
+
+        template <typename... Args>
+        struct AsyncAdapter<RspExitReason(uint8_t*, Args...)> {
+            template <RspUcodeFunc* Fallback>
+            static RspExitReason run(uint8_t* rdram, Args... args) {
+                if (submit_task(rdram, dmem)) {
+                    return RspExitReason::Broke;
+                }
+                return Fallback(rdram, args...);
+            }
+        };
+
+        template <RspUcodeFunc* Fallback>
+        constexpr RspUcodeFunc* async_ucode = &AsyncAdapter<RspUcodeFunc>::template run<Fallback>;
+    }
+}
+
+#endif
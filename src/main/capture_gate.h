@@ -0,0 +1,60 @@
+#ifndef __CAPTURE_GATE_H__
+#define __CAPTURE_GATE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace zelda64 {
+    // Lets one thread stop a recording while another thread is recording into it, without the recording thread
+    // taking a lock. The recording thread wraps each use of the recording's state in try_enter and leave. Once close
+    // returns, the recording thread has left and can't enter again, so the state can be flushed and freed.
+    class CaptureGate {
+    public:
+        bool is_open() const {
+            return open_flag.load(std::memory_order_acquire);
+        }
+
+        // Called once the recording's state is set up. The release pairs with the acquire in try_enter.
+        void open() {
+            open_flag.store(true, std::memory_order_release);
+        }
+
+        // Returns false if closed, in which case leave must not be called.
+        bool try_enter() {
+            // Keeps the closed case down to a single load.
+            if (!open_flag.load(std::memory_order_acquire)) {
+                return false;
+            }
+            // The count has to be visible before the flag is checked again, and close stores the flag before
+            // checking the count, so both sides use sequentially consistent operations for this handshake.
+            users.fetch_add(1, std::memory_order_seq_cst);
+            if (open_flag.load(std::memory_order_seq_cst)) {
+                return true;
+            }
+            users.fetch_sub(1, std::memory_order_release);
+            return false;
+        }
+
+        void leave() {
+            users.fetch_sub(1, std::memory_order_release);
+        }
+
+        // Closes the gate and waits for the recording thread to leave. Returns false if the gate was already closed.
+        bool close() {
+            if (!open_flag.exchange(false, std::memory_order_seq_cst)) {
+                return false;
+            }
+            while (users.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+    private:
+        std::atomic<bool> open_flag = false;
+        std::atomic<uint32_t> users = 0;
+    };
+}
+
+#endif
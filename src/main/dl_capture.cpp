@@ -0,0 +1,497 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "dl_capture.h"
+#include "capture_gate.h"
+#include "spsc_ring_buffer.h"
+
+// Size of the queue between the renderer thread and the writer thread. Holds a few keyframes' worth of pages.
+constexpr size_t capture_queue_size = size_t{32} << 20;
+// How long either side waits for the other when the queue is full or empty.
+constexpr auto capture_wait_interval = std::chrono::milliseconds(1);
+// Runs shorter than this are cheaper to store as literal words.
+constexpr uint32_t min_run_length = 3;
+constexpr uint32_t max_token_length = 0x7FFF;
+constexpr uint16_t token_run_flag = 0x8000;
+constexpr uint32_t page_words = zelda64::dl_capture::page_size / sizeof(uint32_t);
+
+// Fields written at the start of every frame, in file order.
+struct FrameHeader {
+    uint32_t ucode;
+    uint32_t ucode_data;
+    uint32_t ucode_data_size;
+    uint32_t data_ptr;
+    uint32_t flags;
+    ultramodern::renderer::ViRegs vi_regs;
+};
+
+struct CaptureState {
+    FILE* file = nullptr;
+    // Open while capturing. The renderer thread records frames inside the gate, so stop can free the state below.
+    zelda64::CaptureGate gate;
+    // RDRAM contents as of the last frame, used to find the pages that changed since then.
+    std::unique_ptr<uint8_t[]> shadow_rdram;
+    // Reused between frames to avoid allocating on every display list.
+    std::vector<uint32_t> recorded_pages;
+    std::unique_ptr<zelda64::SpscRingBuffer<uint8_t>> queue;
+    uint64_t frame_count = 0;
+    // Only used by the writer thread until it's joined.
+    std::vector<uint64_t> frame_offsets;
+    uint64_t file_offset = 0;
+    // Set by the writer thread on the first failed write. The rest of the capture is dropped, as every frame depends
+    // on the previous ones.
+    std::atomic<bool> write_failed = false;
+    std::atomic<bool> stop_requested = false;
+    std::thread writer_thread;
+};
+
+static CaptureState capture_state{};
+
+static bool write_bytes(FILE* file, const void* data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+static bool read_bytes(FILE* file, void* data, size_t size) {
+    return fread(data, 1, size, file) == size;
+}
+
+static bool write_u32(FILE* file, uint32_t value) {
+    return write_bytes(file, &value, sizeof(value));
+}
+
+static bool read_u32(FILE* file, uint32_t& value) {
+    return read_bytes(file, &value, sizeof(value));
+}
+
+static bool seek_file(FILE* file, int64_t offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, offset, origin) == 0;
+#endif
+}
+
+static int64_t tell_file(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+// Compresses a page into tokens. Each token is a u16: with the run flag set it's followed by one word that repeats
+// the given number of times, otherwise it's followed by that many literal words.
+static void encode_page(const uint8_t* page, std::vector<uint8_t>& out) {
+    uint32_t words[page_words];
+    memcpy(words, page, zelda64::dl_capture::page_size);
+    out.clear();
+
+    auto emit = [&out](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+    auto flush_literals = [&](uint32_t start, uint32_t end) {
+        if (start != end) {
+            uint16_t token = uint16_t(end - start);
+            emit(&token, sizeof(token));
+            emit(words + start, (end - start) * sizeof(uint32_t));
+        }
+    };
+
+    uint32_t literal_start = 0;
+    uint32_t i = 0;
+    while (i < page_words) {
+        uint32_t run = 1;
+        while (i + run < page_words && run < max_token_length && words[i + run] == words[i]) {
+            run++;
+        }
+
+        if (run < min_run_length) {
+            i++;
+            continue;
+        }
+
+        flush_literals(literal_start, i);
+        uint16_t token = uint16_t(token_run_flag | run);
+        emit(&token, sizeof(token));
+        emit(&words[i], sizeof(uint32_t));
+        i += run;
+        literal_start = i;
+    }
+    flush_literals(literal_start, page_words);
+}
+
+static bool decode_page(const uint8_t* in, size_t size, uint8_t* page) {
+    size_t pos = 0;
+    uint32_t word_index = 0;
+    while (pos < size) {
+        uint16_t token;
+        if (size - pos < sizeof(token)) {
+            return false;
+        }
+        memcpy(&token, in + pos, sizeof(token));
+        pos += sizeof(token);
+
+        uint32_t length = token & max_token_length;
+        bool run = (token & token_run_flag) != 0;
+        size_t data_size = run ? sizeof(uint32_t) : size_t{length} * sizeof(uint32_t);
+        if (length > page_words - word_index || size - pos < data_size) {
+            return false;
+        }
+
+        if (run) {
+            for (uint32_t i = 0; i < length; i++) {
+                memcpy(page + (word_index + i) * sizeof(uint32_t), in + pos, sizeof(uint32_t));
+            }
+        }
+        else {
+            memcpy(page + word_index * sizeof(uint32_t), in + pos, data_size);
+        }
+        pos += data_size;
+        word_index += length;
+    }
+    return word_index == page_words;
+}
+
+// Renderer thread only. Frames can't be dropped as each one depends on the last, so this waits for the writer
+// thread when the queue is full.
+static void queue_bytes(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size != 0) {
+        size_t written = capture_state.queue->write(bytes, size);
+        bytes += written;
+        size -= written;
+        if (size != 0) {
+            std::this_thread::sleep_for(capture_wait_interval);
+        }
+    }
+}
+
+// Writer thread only. Returns false once a stop has been requested and the queue has run out.
+static bool dequeue_bytes(void* data, size_t size) {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size != 0) {
+        size_t read_count = capture_state.queue->read(bytes, size);
+        bytes += read_count;
+        size -= read_count;
+        if (size != 0) {
+            if (capture_state.stop_requested.load(std::memory_order_acquire) && capture_state.queue->size() == 0) {
+                return false;
+            }
+            std::this_thread::sleep_for(capture_wait_interval);
+        }
+    }
+    return true;
+}
+
+static void capture_writer_thread() {
+    auto page = std::make_unique<uint8_t[]>(zelda64::dl_capture::page_size);
+    std::vector<uint8_t> encoded;
+    encoded.reserve(zelda64::dl_capture::page_size * 2);
+
+    FrameHeader header;
+    uint32_t frame_page_count;
+    FILE* file = capture_state.file;
+    bool ok = true;
+    // Frames keep getting drained after a failure, so the renderer thread is never left waiting on a full queue.
+    while (dequeue_bytes(&header, sizeof(header)) && dequeue_bytes(&frame_page_count, sizeof(frame_page_count))) {
+        if (ok) {
+            capture_state.frame_offsets.push_back(capture_state.file_offset);
+            ok = write_bytes(file, &header, sizeof(header)) && write_u32(file, frame_page_count);
+            capture_state.file_offset += sizeof(header) + sizeof(frame_page_count);
+        }
+
+        for (uint32_t i = 0; i < frame_page_count; i++) {
+            uint32_t page_index;
+            dequeue_bytes(&page_index, sizeof(page_index));
+            dequeue_bytes(page.get(), zelda64::dl_capture::page_size);
+            if (!ok) {
+                continue;
+            }
+            encode_page(page.get(), encoded);
+
+            ok = write_u32(file, page_index) && write_u32(file, uint32_t(encoded.size())) &&
+                write_bytes(file, encoded.data(), encoded.size());
+            capture_state.file_offset += 2 * sizeof(uint32_t) + encoded.size();
+        }
+
+        if (!ok) {
+            capture_state.write_failed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+static bool page_is_zero(const uint8_t* page) {
+    for (uint32_t offset = 0; offset < zelda64::dl_capture::page_size; offset += sizeof(uint64_t)) {
+        uint64_t value;
+        memcpy(&value, page + offset, sizeof(value));
+        if (value != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool zelda64::dl_capture::start(const std::filesystem::path& path) {
+    if (capture_state.gate.is_open()) {
+        return false;
+    }
+
+#ifdef _WIN32
+    capture_state.file = _wfopen(path.c_str(), L"wb");
+#else
+    capture_state.file = fopen(path.c_str(), "wb");
+#endif
+    if (capture_state.file == nullptr) {
+        return false;
+    }
+
+    setvbuf(capture_state.file, nullptr, _IOFBF, size_t{1} << 20);
+    if (!write_bytes(capture_state.file, file_magic, sizeof(file_magic)) || !write_u32(capture_state.file, rdram_size) ||
+        !write_u32(capture_state.file, page_size) || !write_u32(capture_state.file, uint32_t(sizeof(ultramodern::renderer::ViRegs))))
+    {
+        fclose(capture_state.file);
+        capture_state.file = nullptr;
+        return false;
+    }
+    capture_state.file_offset = sizeof(file_magic) + 3 * sizeof(uint32_t);
+
+    // Zeroed, so the pages that are never written are left out of the keyframes from the start.
+    capture_state.shadow_rdram = std::make_unique<uint8_t[]>(rdram_size);
+    capture_state.queue = std::make_unique<SpscRingBuffer<uint8_t>>(capture_queue_size);
+    capture_state.frame_count = 0;
+    capture_state.frame_offsets.clear();
+    capture_state.write_failed = false;
+    capture_state.stop_requested = false;
+    capture_state.writer_thread = std::thread{capture_writer_thread};
+    capture_state.gate.open();
+    return true;
+}
+
+void zelda64::dl_capture::stop() {
+    // Wait for any frame being recorded to be queued in full, so the writer sees complete frames only.
+    if (!capture_state.gate.close()) {
+        return;
+    }
+
+    capture_state.stop_requested.store(true, std::memory_order_release);
+    capture_state.writer_thread.join();
+
+    // Without the index, a capture that failed partway can still be loaded up to the last complete frame.
+    FILE* file = capture_state.file;
+    bool write_failed = capture_state.write_failed.load(std::memory_order_relaxed);
+    bool ok = !write_failed;
+    if (ok) {
+        uint64_t index_offset = capture_state.file_offset;
+        for (uint64_t offset : capture_state.frame_offsets) {
+            ok = ok && write_bytes(file, &offset, sizeof(offset));
+        }
+        ok = ok && write_u32(file, uint32_t(capture_state.frame_offsets.size())) &&
+            write_bytes(file, &index_offset, sizeof(index_offset)) && write_bytes(file, end_magic, sizeof(end_magic));
+    }
+    ok = (fclose(file) == 0) && ok;
+
+    capture_state.file = nullptr;
+    capture_state.shadow_rdram.reset();
+    capture_state.queue.reset();
+    if (ok) {
+        printf("Captured %llu display lists\n", (unsigned long long)capture_state.frame_offsets.size());
+    }
+    else {
+        // The frame that was being written when a write failed is incomplete.
+        size_t complete_frames = capture_state.frame_offsets.size() - (write_failed ? 1 : 0);
+        fprintf(stderr, "Failed to write the display list capture after %llu display lists, the file is incomplete\n",
+            (unsigned long long)complete_frames);
+    }
+}
+
+bool zelda64::dl_capture::is_active() {
+    return capture_state.gate.is_open();
+}
+
+static void record_captured_frame(const uint8_t* rdram, const OSTask* task) {
+    using namespace zelda64::dl_capture;
+
+    bool keyframe = capture_state.frame_count % keyframe_interval == 0;
+    capture_state.frame_count++;
+
+    FrameHeader header{
+        .ucode = uint32_t(task->t.ucode),
+        .ucode_data = uint32_t(task->t.ucode_data),
+        .ucode_data_size = uint32_t(task->t.ucode_data_size),
+        .data_ptr = uint32_t(task->t.data_ptr),
+        .flags = keyframe ? frame_flag_keyframe : 0,
+        .vi_regs = *ultramodern::renderer::get_vi_regs()
+    };
+
+    // Find the pages to record first, as the page count comes before the pages. Diffing the whole of RDRAM is
+    // simpler than tracking what each display list references and costs well under a millisecond per frame.
+    std::vector<uint32_t>& recorded_pages = capture_state.recorded_pages;
+    recorded_pages.clear();
+    uint8_t* shadow = capture_state.shadow_rdram.get();
+    for (uint32_t page = 0; page < page_count; page++) {
+        uint32_t offset = page * page_size;
+        bool changed = memcmp(rdram + offset, shadow + offset, page_size) != 0;
+        if (changed) {
+            memcpy(shadow + offset, rdram + offset, page_size);
+        }
+        if (keyframe ? !page_is_zero(shadow + offset) : changed) {
+            recorded_pages.push_back(page);
+        }
+    }
+
+    uint32_t recorded_page_count = uint32_t(recorded_pages.size());
+    queue_bytes(&header, sizeof(header));
+    queue_bytes(&recorded_page_count, sizeof(recorded_page_count));
+    for (uint32_t page : recorded_pages) {
+        queue_bytes(&page, sizeof(page));
+        queue_bytes(shadow + page * page_size, page_size);
+    }
+}
+
+void zelda64::dl_capture::record_frame(const uint8_t* rdram, const OSTask* task) {
+    if (!capture_state.gate.try_enter()) {
+        return;
+    }
+    if (!capture_state.write_failed.load(std::memory_order_relaxed)) {
+        record_captured_frame(rdram, task);
+    }
+    capture_state.gate.leave();
+}
+
+zelda64::dl_capture::Reader::~Reader() {
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+static bool read_frame_header(FILE* file, zelda64::dl_capture::FrameInfo& frame_out) {
+    FrameHeader header;
+    if (!read_bytes(file, &header, sizeof(header))) {
+        return false;
+    }
+    frame_out.ucode = header.ucode;
+    frame_out.ucode_data = header.ucode_data;
+    frame_out.ucode_data_size = header.ucode_data_size;
+    frame_out.data_ptr = header.data_ptr;
+    frame_out.flags = header.flags;
+    frame_out.vi_regs = header.vi_regs;
+    return true;
+}
+
+bool zelda64::dl_capture::Reader::open(const std::filesystem::path& path) {
+#ifdef _WIN32
+    file = _wfopen(path.c_str(), L"rb");
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[sizeof(file_magic)];
+    uint32_t file_rdram_size, file_page_size, file_vi_regs_size;
+    if (!read_bytes(file, magic, sizeof(magic)) || memcmp(magic, file_magic, sizeof(magic)) != 0 ||
+        !read_u32(file, file_rdram_size) || !read_u32(file, file_page_size) || !read_u32(file, file_vi_regs_size) ||
+        file_rdram_size != rdram_size || file_page_size != page_size || file_vi_regs_size != sizeof(ultramodern::renderer::ViRegs))
+    {
+        return false;
+    }
+    int64_t frames_start = tell_file(file);
+
+    // Use the frame index if the capture was stopped cleanly. The index has to end exactly where the footer starts,
+    // so that a corrupt footer can't cause a huge allocation.
+    frames.clear();
+    constexpr int64_t footer_size = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(end_magic);
+    uint32_t indexed_frame_count;
+    uint64_t index_offset;
+    int64_t file_size = seek_file(file, 0, SEEK_END) ? tell_file(file) : -1;
+    if (file_size >= frames_start + footer_size && seek_file(file, -footer_size, SEEK_END) && read_u32(file, indexed_frame_count) &&
+        read_bytes(file, &index_offset, sizeof(index_offset)) && read_bytes(file, magic, sizeof(magic)) &&
+        memcmp(magic, end_magic, sizeof(magic)) == 0 && index_offset >= uint64_t(frames_start) &&
+        index_offset + uint64_t{indexed_frame_count} * sizeof(uint64_t) + footer_size == uint64_t(file_size) &&
+        seek_file(file, int64_t(index_offset), SEEK_SET))
+    {
+        std::vector<uint64_t> offsets(indexed_frame_count);
+        if (!read_bytes(file, offsets.data(), offsets.size() * sizeof(uint64_t))) {
+            return false;
+        }
+        frames.resize(indexed_frame_count);
+        for (size_t i = 0; i < frames.size(); i++) {
+            frames[i].file_offset = offsets[i];
+            if (offsets[i] < uint64_t(frames_start) || offsets[i] >= index_offset || !seek_file(file, int64_t(offsets[i]), SEEK_SET) || !read_frame_header(file, frames[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Otherwise walk the frames in order. A frame cut off by the game exiting mid-capture is dropped.
+    int64_t offset = frames_start;
+    while (seek_file(file, offset, SEEK_SET)) {
+        FrameInfo frame;
+        frame.file_offset = uint64_t(offset);
+        uint32_t frame_page_count;
+        if (!read_frame_header(file, frame) || !read_u32(file, frame_page_count)) {
+            break;
+        }
+
+        bool complete = true;
+        for (uint32_t i = 0; i < frame_page_count && complete; i++) {
+            uint32_t page_index, encoded_size;
+            complete = read_u32(file, page_index) && read_u32(file, encoded_size) && seek_file(file, encoded_size, SEEK_CUR);
+        }
+        int64_t next_offset = tell_file(file);
+        if (!complete || !seek_file(file, 0, SEEK_END) || tell_file(file) < next_offset) {
+            break;
+        }
+
+        frames.push_back(frame);
+        offset = next_offset;
+    }
+    return true;
+}
+
+bool zelda64::dl_capture::Reader::load_frame(size_t index, uint8_t* rdram) {
+    const FrameInfo& frame = frames[index];
+    FrameInfo header;
+    uint32_t frame_page_count;
+    if (!seek_file(file, int64_t(frame.file_offset), SEEK_SET) || !read_frame_header(file, header) || !read_u32(file, frame_page_count)) {
+        return false;
+    }
+
+    if (frame.flags & frame_flag_keyframe) {
+        memset(rdram, 0, rdram_size);
+    }
+
+    for (uint32_t i = 0; i < frame_page_count; i++) {
+        uint32_t page_index, encoded_size;
+        if (!read_u32(file, page_index) || !read_u32(file, encoded_size) || page_index >= page_count) {
+            return false;
+        }
+        encoded_page.resize(encoded_size);
+        if (!read_bytes(file, encoded_page.data(), encoded_size) ||
+            !decode_page(encoded_page.data(), encoded_size, rdram + page_index * page_size))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool zelda64::dl_capture::Reader::seek(size_t index, uint8_t* rdram) {
+    size_t keyframe = index;
+    while (keyframe > 0 && (frames[keyframe].flags & frame_flag_keyframe) == 0) {
+        keyframe--;
+    }
+
+    for (size_t i = keyframe; i <= index; i++) {
+        if (!load_frame(i, rdram)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef __DL_CAPTURE_H__
+#define __DL_CAPTURE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#include "ultramodern/ultra64.h"
+#include "ultramodern/renderer_context.hpp"
+
+// Recording of the display lists sent to the renderer, for replaying them without the game to benchmark the renderer.
+//
+// RDRAM is tracked in pages. Each frame stores the pages that changed since the previous frame, and every
+// keyframe_interval frames a keyframe stores every page that isn't all zeroes, so replays can start at any keyframe.
+// Pages are compressed by collapsing runs of repeated words, which covers the cleared buffers and flat textures
+// that make up most of a frame's changes.
+//
+// File layout, all values in host byte order:
+//   magic (8 bytes), rdram size (u32), page size (u32), VI register block size (u32).
+//   For each frame: ucode, ucode data, ucode data size, data ptr (u32 each), flags (u32), VI registers,
+//                   page count (u32), then (u32 page index, u32 encoded size, encoded page) entries.
+//   Frame index: the file offset of each frame (u64), then frame count (u32), index offset (u64) and the end magic.
+// A capture cut off before the index was written can still be loaded by scanning the frames in order.
+namespace zelda64 {
+    namespace dl_capture {
+        constexpr char file_magic[8] = { 'D', 'L', 'C', 'A', 'P', '0', '0', '1' };
+        constexpr char end_magic[8] = { 'D', 'L', 'C', 'A', 'P', 'E', 'N', 'D' };
+        constexpr uint32_t rdram_size = 8 * 1024 * 1024;
+        constexpr uint32_t page_size = 0x1000;
+        constexpr uint32_t page_count = rdram_size / page_size;
+        constexpr uint32_t keyframe_interval = 300;
+
+        constexpr uint32_t frame_flag_keyframe = 1 << 0;
+
+        struct FrameInfo {
+            uint32_t ucode;
+            uint32_t ucode_data;
+            uint32_t ucode_data_size;
+            uint32_t data_ptr;
+            uint32_t flags;
+            ultramodern::renderer::ViRegs vi_regs;
+            uint64_t file_offset;
+        };
+
+        bool start(const std::filesystem::path& path);
+        void stop();
+        bool is_active();
+
+        // Records the task and the RDRAM it can reference. Must be called before the renderer processes the task, so
+        // the recording has the RDRAM the task will read. Anything the renderer wrote back to RDRAM while processing
+        // earlier tasks, e.g. framebuffer copies, is recorded as well, just as the game would see it.
+        void record_frame(const uint8_t* rdram, const OSTask* task);
+
+        class Reader {
+        public:
+            ~Reader();
+
+            bool open(const std::filesystem::path& path);
+            size_t frame_count() const { return frames.size(); }
+            const FrameInfo& get_frame(size_t index) const { return frames[index]; }
+
+            // Applies the frame's pages to the given RDRAM, which must hold the state of the previous frame unless
+            // the frame is a keyframe.
+            bool load_frame(size_t index, uint8_t* rdram);
+            // Rebuilds the RDRAM state of any frame, starting from the closest keyframe before it.
+            bool seek(size_t index, uint8_t* rdram);
+
+        private:
+            FILE* file = nullptr;
+            std::vector<FrameInfo> frames;
+            std::vector<uint8_t> encoded_page;
+        };
+    }
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <cassert>
 #include <unordered_map>
 #include <vector>
@@ -7,6 +9,8 @@
 #include <numeric>
 #include <stdexcept>
 #include <cinttypes>
+#include <chrono>
+#include <atomic>
 
 #include "nfd.h"
 
@@ -39,6 +43,18 @@
 #include "librecomp/game.hpp"
 #include "librecomp/mods.hpp"
 #include "librecomp/helpers.hpp"
+#include "audio_resampler.h"
+#include "audio_convert.h"
+#include "audio_backend.h"
+#include "audio_rate_control.h"
+#include "audio_queue_clock.h"
+#include "audio_capture.h"
+#include "rsp_task_capture.h"
+#include "dl_capture.h"
+#include "audio_hle.h"
+#include "audio_task_thread.h"
+#include "zelda_audio_stats.h"
+#include "zelda_input_movie.h"
 
 #if 0
 #include "../../patches/graphics.h"
@@ -76,6 +92,11 @@ ultramodern::gfx_callbacks_t::gfx_data_t create_gfx() {
     SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
     SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
 
+    // The null renderer doesn't present anything, so don't require a display. SDL_VIDEODRIVER still takes priority.
+    if (zelda64::renderer::get_renderer_type() == zelda64::renderer::RendererType::Null) {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) > 0) {
         exit_error("Failed to initialize SDL2: %s\n", SDL_GetError());
     }
@@ -139,11 +160,17 @@ SDL_Window* window;
 ultramodern::renderer::WindowHandle create_window(ultramodern::gfx_callbacks_t::gfx_data_t) {
     uint32_t flags = SDL_WINDOW_RESIZABLE;
 
+    // The null renderer only needs a window for SDL's event handling, so it doesn't need a graphics API's surface.
+    if (zelda64::renderer::get_renderer_type() == zelda64::renderer::RendererType::Null) {
+        flags = SDL_WINDOW_HIDDEN;
+    }
+    else {
 #if defined(__APPLE__)
-    flags |= SDL_WINDOW_METAL;
+        flags |= SDL_WINDOW_METAL;
 #elif defined(RT64_SDL_WINDOW_VULKAN)
-    flags |= SDL_WINDOW_VULKAN;
+        flags |= SDL_WINDOW_VULKAN;
 #endif
+    }
 
     window = SDL_CreateWindow("Zelda 64: Recompiled", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1600, 960,  flags);
 #if defined(__linux__)
@@ -175,12 +202,32 @@ ultramodern::renderer::WindowHandle create_window(ultramodern::gfx_callbacks_t::
 #endif
 }
 
+// Number of VIs after which the game quits on its own, or zero to run until the user quits. Unattended runs, e.g.
+// with the null renderer, can't be quit otherwise, and the capture files are only finalized on a normal quit.
+static uint64_t exit_after_vis = 0;
+static std::atomic<uint64_t> vi_count = 0;
+static std::atomic<bool> exit_requested = false;
+
+void vi_callback() {
+    recomp::update_rumble();
+
+    if (exit_after_vis != 0 && vi_count.fetch_add(1, std::memory_order_relaxed) + 1 == exit_after_vis) {
+        exit_requested.store(true, std::memory_order_release);
+    }
+}
+
 void update_gfx(void*) {
     recomp::handle_events();
+
+    // Quit from the gfx thread, the same as the quit prompt does.
+    if (exit_requested.exchange(false, std::memory_order_acquire)) {
+        printf("Quitting after %llu VIs\n", (unsigned long long)exit_after_vis);
+        ultramodern::quit();
+    }
 }
 
-static SDL_AudioCVT audio_convert;
-static SDL_AudioDeviceID audio_device = 0;
+static std::unique_ptr<zelda64::audio::Backend> audio_backend;
+static zelda64::audio::BackendType audio_backend_type = zelda64::audio::BackendType::SDLQueue;
 
 // Samples per channel per second.
 static uint32_t sample_rate = 48000;
@@ -191,148 +238,148 @@ static uint32_t output_channels = 2;
 
 // Terminology: a frame is a collection of samples for each channel. e.g. 2 input samples is one input frame. This is unrelated to graphical frames.
 
-// Number of frames to duplicate for fixing interpolation at the start and end of a chunk.
-constexpr uint32_t duplicated_input_frames = 4;
-// The number of output frames to skip for playback (to avoid playing duplicate inputs twice).
-static uint32_t discarded_output_frames;
-
-constexpr uint32_t bytes_per_frame = input_channels * sizeof(float);
+// Stateful resampler, which keeps the filter history between queued chunks so that no frames need to be duplicated at chunk boundaries.
+// Only accessed from the audio thread and from `reset_audio` before the game starts.
+static zelda64::audio::Resampler resampler;
+static zelda64::audio::RateController rate_controller;
+// Model of the backend's queue, which lets get_frames_remaining avoid querying the device on every call.
+// Accessed from the audio thread and from `reset_audio` before the game starts.
+static zelda64::audio::QueueClock queue_clock;
 
 void queue_samples(int16_t* audio_data, size_t sample_count) {
-    // Buffer for holding the output of swapping the audio channels. This is reused across
-    // calls to reduce runtime allocations.
-    static std::vector<float> swap_buffer;
-    static std::array<float, duplicated_input_frames * input_channels> duplicated_sample_buffer;
+    // Buffer for holding the resampled output. This is reused across calls to reduce runtime allocations.
+    static std::vector<float> output_buffer;
 
-    // Make sure the swap buffer is large enough to hold the audio data, including any extra space needed for resampling.
-    size_t resampled_sample_count = sample_count + duplicated_input_frames * input_channels;
-    size_t max_sample_count = std::max(resampled_sample_count, resampled_sample_count * audio_convert.len_mult);
-    if (max_sample_count > swap_buffer.size()) {
-        swap_buffer.resize(max_sample_count);
-    }
-    
-    // Copy the duplicated frames from last chunk into this chunk
-    for (size_t i = 0; i < duplicated_input_frames * input_channels; i++) {
-        swap_buffer[i] = duplicated_sample_buffer[i];
-    }
+    // Apply any change to the resampler mode or latency target made in the config menu.
+    resampler.set_mode(zelda64::get_resampler_mode());
+    rate_controller.set_target_frames(uint64_t(zelda64::get_audio_latency()) * output_sample_rate / 1000);
+
+    size_t frame_count = sample_count / input_channels;
+
+    // The audio may have been produced by a task that's still running on the audio task thread.
+    zelda64::audio_hle::wait_for_task();
 
     // Convert the audio from 16-bit values to floats and swap the audio channels into the
-    // swap buffer to correct for the address xor caused by endianness handling.
+    // resampler's input buffer to correct for the address xor caused by endianness handling.
+    float* input_buffer = resampler.get_input_buffer(frame_count);
     float cur_main_volume = zelda64::get_main_volume() / 100.0f; // Get the current main volume, normalized to 0.0-1.0.
-    for (size_t i = 0; i < sample_count; i += input_channels) {
-        swap_buffer[i + 0 + duplicated_input_frames * input_channels] = audio_data[i + 1] * (0.5f / 32768.0f) * cur_main_volume;
-        swap_buffer[i + 1 + duplicated_input_frames * input_channels] = audio_data[i + 0] * (0.5f / 32768.0f) * cur_main_volume;
-    }
-    
-    // TODO handle cases where a chunk is smaller than the duplicated frame count.
-    assert(sample_count > duplicated_input_frames * input_channels);
-
-    // Copy the last converted samples into the duplicated sample buffer to reuse in resampling the next queued chunk.
-    for (size_t i = 0; i < duplicated_input_frames * input_channels; i++) {
-        duplicated_sample_buffer[i] = swap_buffer[i + sample_count];
+    auto convert_start = std::chrono::steady_clock::now();
+    zelda64::audio::convert_samples(audio_data, input_buffer, frame_count * input_channels, (0.5f / 32768.0f) * cur_main_volume);
+    auto convert_end = std::chrono::steady_clock::now();
+    zelda64::audio::record_convert_time(std::chrono::duration_cast<std::chrono::nanoseconds>(convert_end - convert_start).count());
+
+    // Capture the game's audio before resampling, which keeps captures comparable regardless of the output device and rate control.
+    zelda64::audio::capture_frames(input_buffer, frame_count);
+
+    // Prevent audio latency from building up or the output from running dry by slightly adjusting the resampling ratio
+    // based on how much audio is already queued. A backend that doesn't play the audio in real time has no queue to
+    // steer, so the audio is resampled at the nominal ratio.
+    size_t queued_frames = audio_backend->get_queued_frames();
+    auto queue_time = std::chrono::steady_clock::now();
+    queue_clock.resync(queued_frames, queue_time);
+    double rate_adjust = 1.0;
+    bool rate_saturated = false;
+    if (audio_backend->consumes_in_real_time()) {
+        rate_adjust = rate_controller.update(queued_frames);
+        rate_saturated = rate_controller.is_saturated();
     }
-    
-    audio_convert.buf = reinterpret_cast<Uint8*>(swap_buffer.data());
-    audio_convert.len = (sample_count + duplicated_input_frames * input_channels) * sizeof(swap_buffer[0]);
-
-    int ret = SDL_ConvertAudio(&audio_convert);
+    zelda64::audio::record_queued_chunk(uint64_t(queued_frames) * 1000000 / output_sample_rate, rate_adjust, rate_saturated);
 
-    if (ret < 0) {
-        printf("Error using SDL audio converter: %s\n", SDL_GetError());
-        throw std::runtime_error("Error using SDL audio converter");
+    // Resample straight into the output buffer.
+    size_t max_output_frames = resampler.max_output_frames(frame_count, rate_adjust);
+    if (max_output_frames * output_channels > output_buffer.size()) {
+        output_buffer.resize(max_output_frames * output_channels);
     }
+    size_t output_frames = resampler.process(frame_count, output_buffer.data(), max_output_frames, rate_adjust);
 
-    uint64_t cur_queued_microseconds = uint64_t(SDL_GetQueuedAudioSize(audio_device)) / bytes_per_frame * 1000000 / sample_rate;
-    uint32_t num_bytes_to_queue = audio_convert.len_cvt - output_channels * discarded_output_frames * sizeof(swap_buffer[0]);
-    float* samples_to_queue = swap_buffer.data() + output_channels * discarded_output_frames / 2;
-
-    // Prevent audio latency from building up by skipping samples in incoming audio when too many samples are already queued.
-    // Skip samples based on how many microseconds of samples are queued already.
-    uint32_t skip_factor = cur_queued_microseconds / 100000;
-    if (skip_factor != 0) {
-        uint32_t skip_ratio = 1 << skip_factor;
-        num_bytes_to_queue /= skip_ratio;
-        for (size_t i = 0; i < num_bytes_to_queue / (output_channels * sizeof(swap_buffer[0])); i++) {
-            samples_to_queue[2 * i + 0] = samples_to_queue[2 * skip_ratio * i + 0];
-            samples_to_queue[2 * i + 1] = samples_to_queue[2 * skip_ratio * i + 1];
-        }
+    // The rate adjustment is too small to recover from a long stall in a reasonable time, so drop the chunk if that happens.
+    if (rate_controller.is_overflowing(queued_frames)) {
+        zelda64::audio::record_dropped_chunk();
+        return;
     }
 
-    // Queue the swapped audio data.
-    // Offset the data start by only half the discarded frame count as the other half of the discarded frames are at the end of the buffer.
-    SDL_QueueAudio(audio_device, samples_to_queue, num_bytes_to_queue);
+    // Queue the resampled audio data.
+    audio_backend->queue_frames(output_buffer.data(), output_frames);
+    queue_clock.add_frames(output_frames, queue_time);
 }
 
 size_t get_frames_remaining() {
     constexpr float buffer_offset_frames = 1.0f;
-    // Get the number of remaining buffered audio bytes.
-    uint64_t buffered_byte_count = SDL_GetQueuedAudioSize(audio_device);
+    // Predict the number of remaining buffered audio frames from the queue model, only asking the device when the
+    // game hasn't queued audio (which resyncs the model) in a while.
+    double queued_frames;
+    if (audio_backend->consumes_in_real_time()) {
+        auto now = std::chrono::steady_clock::now();
+        if (queue_clock.needs_resync(now)) {
+            queue_clock.resync(audio_backend->get_queued_frames(), now);
+        }
+        queued_frames = queue_clock.predict(now);
+    }
+    else {
+        queued_frames = double(audio_backend->get_queued_frames());
+    }
 
-    // Scale the byte count based on the ratio of sample rates and channel counts.
-    buffered_byte_count = buffered_byte_count * 2 * sample_rate / output_sample_rate / output_channels;
+    // Scale to the game's sample rate.
+    uint64_t buffered_frames = uint64_t(queued_frames * sample_rate / output_sample_rate);
 
     // Adjust the reported count to be some number of refreshes in the future, which helps ensure that
     // there are enough samples even if the audio thread experiences a small amount of lag. This prevents
     // audio popping on games that use the buffered audio byte count to determine how many samples
     // to generate.
     uint32_t frames_per_vi = (sample_rate / 60);
-    if (buffered_byte_count > (buffer_offset_frames * bytes_per_frame * frames_per_vi)) {
-        buffered_byte_count -= (buffer_offset_frames * bytes_per_frame * frames_per_vi);
+    if (buffered_frames > (buffer_offset_frames * frames_per_vi)) {
+        buffered_frames -= (buffer_offset_frames * frames_per_vi);
     }
     else {
-        buffered_byte_count = 0;
+        buffered_frames = 0;
     }
-    // Convert from byte count to sample count.
-    return static_cast<uint32_t>(buffered_byte_count / bytes_per_frame);
-}
-
-void update_audio_converter() {
-    int ret = SDL_BuildAudioCVT(&audio_convert, AUDIO_F32, input_channels, sample_rate, AUDIO_F32, output_channels, output_sample_rate);
-
-    if (ret < 0) {
-        printf("Error creating SDL audio converter: %s\n", SDL_GetError());
-        throw std::runtime_error("Error creating SDL audio converter");
-    }
-
-    // Calculate the number of samples to discard based on the sample rate ratio and the duplicate frame count.
-    discarded_output_frames = duplicated_input_frames * output_sample_rate / sample_rate;
+    zelda64::audio::record_frames_remaining(buffered_frames);
+    return static_cast<uint32_t>(buffered_frames);
 }
 
 void set_frequency(uint32_t freq) {
     sample_rate = freq;
-    
-    update_audio_converter();
+
+    zelda64::audio::set_capture_rate(sample_rate);
+    resampler.set_rates(sample_rate, output_sample_rate);
 }
 
 void reset_audio(uint32_t output_freq) {
-    SDL_AudioSpec spec_desired{
-        .freq = (int)output_freq,
-        .format = AUDIO_F32,
-        .channels = (Uint8)output_channels,
-        .silence = 0, // calculated
-        .samples = 0x100, // Fairly small sample count to reduce the latency of internal buffering
-        .padding = 0, // unused
-        .size = 0, // calculated
-        .callback = nullptr,
-        .userdata = nullptr
-    };
-
-
-    audio_device = SDL_OpenAudioDevice(nullptr, false, &spec_desired, nullptr, 0);
-    if (audio_device == 0) {
-        exit_error("SDL error opening audio device: %s\n", SDL_GetError());
+    audio_backend = zelda64::audio::create_backend(audio_backend_type);
+    if (!audio_backend->open(output_freq, output_channels)) {
+        exit_error("SDL error opening audio device: %s\nSet RECOMP_AUDIO_BACKEND=null to run without audio output.\n", SDL_GetError());
     }
-    SDL_PauseAudioDevice(audio_device, 0);
 
     output_sample_rate = output_freq;
-    update_audio_converter();
+    resampler.set_rates(sample_rate, output_sample_rate);
+    resampler.reset();
+    rate_controller.set_capacity_frames(audio_backend->get_capacity_frames());
+    queue_clock.reset(output_sample_rate, std::chrono::steady_clock::now());
 }
 
 extern RspUcodeFunc aspMain;
 
+// The native microcode is opt-in until verify mode has confirmed that it matches the recompiled one.
+static zelda64::audio_hle::Mode audio_ucode_mode = zelda64::audio_hle::Mode::Recompiled;
+
 RspUcodeFunc* get_rsp_microcode(const OSTask* task) {
     switch (task->t.type) {
     case M_AUDTASK:
+        // Recordings are meant for benchmarking the recompiled microcode, so capturing always uses it.
+        if (zelda64::rsp_capture::is_active()) {
+            return zelda64::rsp_capture::recording_ucode<aspMain>;
+        }
+        switch (audio_ucode_mode) {
+        case zelda64::audio_hle::Mode::Native:
+            if (zelda64::audio_hle::task_thread_running()) {
+                return zelda64::audio_hle::async_ucode<aspMain>;
+            }
+            return zelda64::audio_hle::native_ucode<aspMain>;
+        case zelda64::audio_hle::Mode::Verify:
+            return zelda64::audio_hle::verifying_ucode<aspMain>;
+        case zelda64::audio_hle::Mode::Recompiled:
+            break;
+        }
         return aspMain;
 
     default:
@@ -360,6 +407,24 @@ std::vector<recomp::GameEntry> supported_games = {
     },
 };
 
+static bool autostart = false;
+
+// Runs on the gfx thread once the renderer has been created.
+void gfx_init() {
+    recompui::update_supported_options();
+
+    // Start the game without waiting on the launcher, which the null renderer can't show.
+    if (autostart) {
+        if (recomp::is_rom_valid(supported_games[0].game_id)) {
+            recomp::start_game(supported_games[0].game_id);
+            recompui::hide_all_contexts();
+        }
+        else {
+            fprintf(stderr, "Can't start the game automatically as no valid ROM has been selected\n");
+        }
+    }
+}
+
 // TODO: move somewhere else
 namespace zelda64 {
     std::string get_game_thread_name(const OSThread* t) {
@@ -599,10 +664,114 @@ int main(int argc, char** argv) {
     std::filesystem::current_path("/var/data", ec);
 #endif
 
-    // Initialize SDL audio and set the output frequency.
-    SDL_InitSubSystem(SDL_INIT_AUDIO);
+    // Allow picking the renderer with an environment variable. The null renderer doesn't need a GPU.
+    const char* renderer_env = getenv("RECOMP_RENDERER");
+    if (renderer_env != nullptr) {
+        zelda64::renderer::RendererType renderer_type;
+        if (zelda64::renderer::renderer_type_from_string(renderer_env, renderer_type)) {
+            zelda64::renderer::set_renderer_type(renderer_type);
+        }
+        else {
+            fprintf(stderr, "Unknown renderer \"%s\", using RT64\n", renderer_env);
+        }
+    }
+
+    // Allow skipping the launcher, e.g. for unattended runs. The null renderer always skips it, as it can't show it.
+    const char* autostart_env = getenv("RECOMP_AUTOSTART");
+    autostart = (autostart_env != nullptr && strcmp(autostart_env, "1") == 0) ||
+        zelda64::renderer::get_renderer_type() == zelda64::renderer::RendererType::Null;
+
+    // Allow quitting after a fixed number of VIs (60 per second), so unattended runs end through the normal shutdown.
+    const char* exit_after_frames_env = getenv("RECOMP_EXIT_AFTER_FRAMES");
+    if (exit_after_frames_env != nullptr) {
+        exit_after_vis = std::strtoull(exit_after_frames_env, nullptr, 0);
+    }
+
+    // Allow logging a hash of every display list from the null renderer, for checking that runs are deterministic.
+    const char* dl_hashes_env = getenv("RECOMP_DL_HASHES");
+    if (dl_hashes_env != nullptr) {
+        zelda64::renderer::set_display_list_hash_path(std::filesystem::u8path(dl_hashes_env));
+    }
+
+    // Allow recording display lists for replaying them with the dl_replay_bench tool.
+    const char* dl_capture_env = getenv("RECOMP_DL_CAPTURE");
+    if (dl_capture_env != nullptr && !zelda64::dl_capture::start(std::filesystem::u8path(dl_capture_env))) {
+        fprintf(stderr, "Failed to open display list capture file \"%s\"\n", dl_capture_env);
+    }
+
+    // Allow picking the audio backend with an environment variable.
+    const char* audio_backend_env = getenv("RECOMP_AUDIO_BACKEND");
+    if (audio_backend_env != nullptr && !zelda64::audio::backend_type_from_string(audio_backend_env, audio_backend_type)) {
+        fprintf(stderr, "Unknown audio backend \"%s\", using the default one\n", audio_backend_env);
+    }
+
+    // Initialize SDL audio and set the output frequency. The null backends don't need an audio device, which allows running on machines without one.
+    if (zelda64::audio::backend_uses_sdl(audio_backend_type)) {
+        SDL_InitSubSystem(SDL_INIT_AUDIO);
+    }
     reset_audio(48000);
 
+    // Allow capturing the game's audio to a file for comparing output across builds.
+    const char* audio_capture_env = getenv("RECOMP_AUDIO_CAPTURE");
+    if (audio_capture_env != nullptr && !zelda64::audio::start_capture(std::filesystem::u8path(audio_capture_env), sample_rate, input_channels)) {
+        fprintf(stderr, "Failed to open audio capture file \"%s\"\n", audio_capture_env);
+    }
+
+    // Allow recording audio tasks for replaying them with the aspmain_replay_bench tool.
+    const char* rsp_capture_env = getenv("RECOMP_RSP_CAPTURE");
+    if (rsp_capture_env != nullptr && !zelda64::rsp_capture::start(std::filesystem::u8path(rsp_capture_env))) {
+        fprintf(stderr, "Failed to open RSP capture file \"%s\"\n", rsp_capture_env);
+    }
+
+    // Allow picking between the native and recompiled audio microcode, or checking one against the other.
+    const char* audio_ucode_env = getenv("RECOMP_AUDIO_UCODE");
+    if (audio_ucode_env != nullptr && !zelda64::audio_hle::mode_from_string(audio_ucode_env, audio_ucode_mode)) {
+        fprintf(stderr, "Unknown audio microcode mode \"%s\", using the recompiled one\n", audio_ucode_env);
+    }
+
+    // Allow running audio tasks on their own thread so that they overlap with the game's other work. This requires the
+    // native microcode (RECOMP_AUDIO_UCODE=native), as the recompiled one works on the runtime's shared DMEM.
+    const char* audio_task_thread_env = getenv("RECOMP_AUDIO_TASK_THREAD");
+    if (audio_task_thread_env != nullptr && strcmp(audio_task_thread_env, "1") == 0) {
+        if (audio_ucode_mode == zelda64::audio_hle::Mode::Native) {
+            zelda64::audio_hle::start_task_thread();
+        }
+        else {
+            fprintf(stderr, "The audio task thread requires RECOMP_AUDIO_UCODE=native, running audio tasks synchronously\n");
+        }
+    }
+
+    // Allow sampling inputs when the game reads the controllers rather than when it polls them, which cuts up to a
+    // frame of input latency. The optional rate controls how often controller state is refreshed between reads.
+    const char* input_sampling_env = getenv("RECOMP_INPUT_SAMPLING");
+    if (input_sampling_env != nullptr) {
+        if (strcmp(input_sampling_env, "jit") == 0) {
+            int pump_rate_hz = 1000;
+            const char* input_pump_rate_env = getenv("RECOMP_INPUT_PUMP_RATE");
+            if (input_pump_rate_env != nullptr) {
+                pump_rate_hz = atoi(input_pump_rate_env);
+            }
+            recomp::start_just_in_time_input(pump_rate_hz);
+        }
+        else if (strcmp(input_sampling_env, "poll") != 0) {
+            fprintf(stderr, "Unknown input sampling mode \"%s\", sampling on the game's polls\n", input_sampling_env);
+        }
+    }
+
+    recomp::start_haptics();
+
+    // Allow recording the game's controller inputs, or playing back a recording in place of the real inputs.
+    const char* input_record_env = getenv("RECOMP_INPUT_RECORD");
+    const char* input_playback_env = getenv("RECOMP_INPUT_PLAYBACK");
+    if (input_playback_env != nullptr) {
+        if (!zelda64::input::start_movie_playback(std::filesystem::u8path(input_playback_env))) {
+            fprintf(stderr, "Failed to load input movie \"%s\"\n", input_playback_env);
+        }
+    }
+    else if (input_record_env != nullptr && !zelda64::input::start_movie_recording(std::filesystem::u8path(input_record_env))) {
+        fprintf(stderr, "Failed to open input movie file \"%s\"\n", input_record_env);
+    }
+
     // Source controller mappings file
     std::u8string controller_db_path = (zelda64::get_program_path() / "recompcontrollerdb.txt").u8string();
     if (SDL_GameControllerAddMappingsFromFile(reinterpret_cast<const char *>(controller_db_path.c_str())) < 0) {
@@ -670,8 +839,8 @@ int main(int argc, char** argv) {
     };
 
     ultramodern::events::callbacks_t thread_callbacks{
-        .vi_callback = recomp::update_rumble,
-        .gfx_init_callback = recompui::update_supported_options,
+        .vi_callback = vi_callback,
+        .gfx_init_callback = gfx_init,
     };
 
     ultramodern::error_handling::callbacks_t error_handling_callbacks{
@@ -708,6 +877,15 @@ int main(int argc, char** argv) {
         threads_callbacks
     );
 
+    zelda64::audio::stop_capture();
+    zelda64::rsp_capture::stop();
+    zelda64::dl_capture::stop();
+    zelda64::input::stop_movie();
+    recomp::stop_just_in_time_input();
+    recomp::stop_haptics();
+    zelda64::audio_hle::stop_task_thread();
+    zelda64::audio_hle::print_verify_summary();
+
     NFD_Quit();
 
     if (preloaded) {
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "ultramodern/ultramodern.hpp"
+#include "zelda_render.h"
+#include "dl_capture.h"
+
+// Size of the RDRAM that display lists can reference.
+constexpr uint32_t null_renderer_rdram_size = 0x800000;
+// Limits that stop a malformed display list from being walked forever.
+constexpr size_t max_display_list_depth = 18;
+constexpr uint64_t max_display_list_commands = 1 << 20;
+
+constexpr uint8_t g_mw_segment = 0x06;
+
+// Opcodes that the walk needs, which differ between the two GBI versions.
+struct GbiOpcodes {
+    uint8_t dl;
+    uint8_t enddl;
+    uint8_t moveword;
+    bool gbi2;
+};
+
+constexpr GbiOpcodes gbi1_opcodes { .dl = 0x06, .enddl = 0xB8, .moveword = 0xBC, .gbi2 = false };
+constexpr GbiOpcodes gbi2_opcodes { .dl = 0xDE, .enddl = 0xDF, .moveword = 0xDB, .gbi2 = true };
+
+static std::filesystem::path display_list_hash_path{};
+// GBI version of each microcode seen so far, keyed by the address of its data section.
+static std::unordered_map<uint32_t, const GbiOpcodes*> ucode_gbi_versions{};
+
+void zelda64::renderer::set_display_list_hash_path(const std::filesystem::path& path) {
+    display_list_hash_path = path;
+}
+
+// RDRAM is stored with each 32-bit word in host order, so bytes have to be read with the address swizzled.
+static uint8_t read_rdram_byte(const uint8_t* rdram, uint32_t address) {
+    return rdram[address ^ 3];
+}
+
+static uint32_t read_rdram_word(const uint8_t* rdram, uint32_t address) {
+    uint32_t ret;
+    memcpy(&ret, rdram + address, sizeof(ret));
+    return ret;
+}
+
+// Picks the GBI version from the microcode's ID string, which is stored in its data section
+// (e.g. "RSP Gfx ucode F3DEX       fifo 2.08  Yoshitaka Yasumoto 1999 Nintendo.").
+static const GbiOpcodes* detect_gbi_version(const uint8_t* rdram, uint32_t ucode_data, uint32_t ucode_data_size) {
+    auto find_it = ucode_gbi_versions.find(ucode_data);
+    if (find_it != ucode_gbi_versions.end()) {
+        return find_it->second;
+    }
+
+    std::string data_string;
+    uint32_t size = std::min(ucode_data_size, null_renderer_rdram_size - std::min(ucode_data, null_renderer_rdram_size));
+    data_string.reserve(size);
+    for (uint32_t i = 0; i < size; i++) {
+        data_string.push_back(char(read_rdram_byte(rdram, ucode_data + i)));
+    }
+
+    const GbiOpcodes* ret = &gbi1_opcodes;
+    for (std::string_view gbi2_name : { "F3DEX2", "F3DZEX", "L3DEX2", "S2DEX2" }) {
+        if (data_string.find(gbi2_name) != std::string::npos) {
+            ret = &gbi2_opcodes;
+            break;
+        }
+    }
+
+    ucode_gbi_versions.emplace(ucode_data, ret);
+    return ret;
+}
+
+zelda64::renderer::NullContext::NullContext(uint8_t* rdram) : rdram(rdram) {
+    if (!display_list_hash_path.empty()) {
+#ifdef _WIN32
+        hash_file = _wfopen(display_list_hash_path.c_str(), L"w");
+#else
+        hash_file = fopen(display_list_hash_path.c_str(), "w");
+#endif
+        if (hash_file == nullptr) {
+            fprintf(stderr, "Failed to open display list hash file\n");
+        }
+    }
+}
+
+zelda64::renderer::NullContext::~NullContext() {
+    if (hash_file != nullptr) {
+        fclose(hash_file);
+    }
+}
+
+void zelda64::renderer::NullContext::send_dl(const OSTask* task) {
+    zelda64::dl_capture::record_frame(rdram, task);
+    const GbiOpcodes* opcodes = detect_gbi_version(rdram, task->t.ucode_data & 0x3FFFFFF, task->t.ucode_data_size);
+
+    std::array<uint32_t, 16> segments{};
+    std::array<uint32_t, max_display_list_depth> stack;
+    size_t depth = 0;
+    uint64_t commands = 0;
+    bool valid = true;
+    // FNV-1a over the command words.
+    uint64_t hash = 0xCBF29CE484222325ull;
+    bool hashing = hash_file != nullptr;
+
+    auto resolve_segmented = [&](uint32_t address) {
+        return (segments[(address >> 24) & 0xF] + (address & 0x00FFFFFF)) & 0x00FFFFFF;
+    };
+
+    uint32_t pc = task->t.data_ptr & 0x00FFFFFF;
+    while (true) {
+        if ((pc & 7) != 0 || pc + 8 > null_renderer_rdram_size || commands == max_display_list_commands) {
+            valid = false;
+            break;
+        }
+
+        uint32_t w0 = read_rdram_word(rdram, pc);
+        uint32_t w1 = read_rdram_word(rdram, pc + 4);
+        commands++;
+        if (hashing) {
+            for (uint32_t word : { w0, w1 }) {
+                for (size_t i = 0; i < 4; i++) {
+                    hash = (hash ^ ((word >> (8 * i)) & 0xFF)) * 0x100000001B3ull;
+                }
+            }
+        }
+
+        uint8_t opcode = uint8_t(w0 >> 24);
+        if (opcode == opcodes->dl) {
+            bool push = ((w0 >> 16) & 0xFF) == 0;
+            if (push) {
+                if (depth == stack.size()) {
+                    valid = false;
+                    break;
+                }
+                stack[depth++] = pc + 8;
+            }
+            pc = resolve_segmented(w1);
+            continue;
+        }
+        else if (opcode == opcodes->enddl) {
+            if (depth == 0) {
+                break;
+            }
+            pc = stack[--depth];
+            continue;
+        }
+        else if (opcode == opcodes->moveword) {
+            uint32_t index = opcodes->gbi2 ? ((w0 >> 16) & 0xFF) : (w0 & 0xFF);
+            uint32_t offset = opcodes->gbi2 ? (w0 & 0xFFFF) : ((w0 >> 8) & 0xFFFF);
+            if (index == g_mw_segment) {
+                segments[(offset >> 2) & 0xF] = w1 & 0x00FFFFFF;
+            }
+        }
+
+        pc += 8;
+    }
+
+    display_list_count++;
+    command_count += commands;
+    if (!valid) {
+        invalid_count++;
+    }
+
+    if (hashing) {
+        fprintf(hash_file, "%llu %016llx %llu%s\n", (unsigned long long)(display_list_count - 1), (unsigned long long)hash,
+            (unsigned long long)commands, valid ? "" : " invalid");
+    }
+}
+
+void zelda64::renderer::NullContext::shutdown() {
+    printf("Null renderer: %llu display lists, %llu commands, %llu invalid\n", (unsigned long long)display_list_count,
+        (unsigned long long)command_count, (unsigned long long)invalid_count);
+
+    if (hash_file != nullptr) {
+        fclose(hash_file);
+        hash_file = nullptr;
+    }
+}
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "rsp_task_capture.h"
+
+// Granularity used when diffing RDRAM. Larger blocks reduce the number of ranges at the cost of recording some unchanged bytes.
+constexpr uint32_t diff_block_size = 64;
+
+struct CaptureState {
+    FILE* file = nullptr;
+    bool wrote_header = false;
+    // RDRAM contents as of the last diff, used to find the bytes that changed since then.
+    std::unique_ptr<uint8_t[]> shadow_rdram;
+    // Reused between diffs to avoid allocating on every task.
+    std::vector<std::pair<uint32_t, uint32_t>> diff_ranges;
+    uint64_t task_count = 0;
+};
+
+static CaptureState capture_state{};
+
+static bool write_u32(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool read_u32(FILE* file, uint32_t& value) {
+    return fread(&value, sizeof(value), 1, file) == 1;
+}
+
+// Writes the ranges of RDRAM that differ from the shadow copy and updates the shadow copy to match.
+static void write_rdram_diff(FILE* file, const uint8_t* rdram, uint8_t* shadow, std::vector<std::pair<uint32_t, uint32_t>>& ranges) {
+    ranges.clear();
+
+    uint32_t offset = 0;
+    while (offset < zelda64::rsp_capture::rdram_size) {
+        if (memcmp(rdram + offset, shadow + offset, diff_block_size) == 0) {
+            offset += diff_block_size;
+            continue;
+        }
+
+        // Merge consecutive changed blocks into one range.
+        uint32_t range_start = offset;
+        while (offset < zelda64::rsp_capture::rdram_size && memcmp(rdram + offset, shadow + offset, diff_block_size) != 0) {
+            offset += diff_block_size;
+        }
+        ranges.emplace_back(range_start, offset - range_start);
+    }
+
+    write_u32(file, uint32_t(ranges.size()));
+    for (const auto& [range_start, range_size] : ranges) {
+        memcpy(shadow + range_start, rdram + range_start, range_size);
+        write_u32(file, range_start);
+        write_u32(file, range_size);
+        fwrite(shadow + range_start, 1, range_size, file);
+    }
+}
+
+bool zelda64::rsp_capture::start(const std::filesystem::path& path) {
+    if (capture_state.file != nullptr) {
+        return false;
+    }
+
+#ifdef _WIN32
+    capture_state.file = _wfopen(path.c_str(), L"wb");
+#else
+    capture_state.file = fopen(path.c_str(), "wb");
+#endif
+    if (capture_state.file == nullptr) {
+        return false;
+    }
+
+    setvbuf(capture_state.file, nullptr, _IOFBF, size_t{1} << 20);
+    capture_state.wrote_header = false;
+    capture_state.shadow_rdram = std::make_unique<uint8_t[]>(rdram_size);
+    capture_state.task_count = 0;
+    return true;
+}
+
+void zelda64::rsp_capture::stop() {
+    if (capture_state.file == nullptr) {
+        return;
+    }
+
+    fclose(capture_state.file);
+    capture_state.file = nullptr;
+    capture_state.shadow_rdram.reset();
+    printf("Captured %llu RSP tasks\n", (unsigned long long)capture_state.task_count);
+}
+
+bool zelda64::rsp_capture::is_active() {
+    return capture_state.file != nullptr;
+}
+
+void zelda64::rsp_capture::begin_task(uint8_t* rdram) {
+    if (capture_state.file == nullptr) {
+        return;
+    }
+
+    // The initial RDRAM image is taken at the first task, so that the recording starts with the game already running.
+    if (!capture_state.wrote_header) {
+        memcpy(capture_state.shadow_rdram.get(), rdram, rdram_size);
+        fwrite(file_magic, 1, sizeof(file_magic), capture_state.file);
+        write_u32(capture_state.file, rdram_size);
+        fwrite(capture_state.shadow_rdram.get(), 1, rdram_size, capture_state.file);
+        capture_state.wrote_header = true;
+    }
+
+    // The runtime has already loaded the task and the microcode's data into DMEM at this point.
+    fwrite(dmem, 1, dmem_size, capture_state.file);
+    write_rdram_diff(capture_state.file, rdram, capture_state.shadow_rdram.get(), capture_state.diff_ranges);
+}
+
+void zelda64::rsp_capture::end_task(uint8_t* rdram) {
+    if (capture_state.file == nullptr) {
+        return;
+    }
+
+    // The CPU keeps running while the task does, so this can include CPU writes. Replays fail on those, as they're
+    // checked against every recorded output byte.
+    write_rdram_diff(capture_state.file, rdram, capture_state.shadow_rdram.get(), capture_state.diff_ranges);
+    capture_state.task_count++;
+}
+
+static bool read_ranges(FILE* file, std::vector<zelda64::rsp_capture::Range>& ranges_out) {
+    uint32_t range_count;
+    if (!read_u32(file, range_count)) {
+        return false;
+    }
+
+    ranges_out.resize(range_count);
+    for (auto& range : ranges_out) {
+        uint32_t range_size;
+        if (!read_u32(file, range.offset) || !read_u32(file, range_size)) {
+            return false;
+        }
+        if (uint64_t{range.offset} + range_size > zelda64::rsp_capture::rdram_size) {
+            return false;
+        }
+        range.bytes.resize(range_size);
+        if (fread(range.bytes.data(), 1, range_size, file) != range_size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool zelda64::rsp_capture::load(const std::filesystem::path& path, Recording& recording_out) {
+#ifdef _WIN32
+    FILE* file = _wfopen(path.c_str(), L"rb");
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[sizeof(file_magic)];
+    uint32_t file_rdram_size;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, file_magic, sizeof(magic)) == 0 &&
+        read_u32(file, file_rdram_size) &&
+        file_rdram_size == rdram_size;
+
+    if (ok) {
+        recording_out.initial_rdram.resize(rdram_size);
+        ok = fread(recording_out.initial_rdram.data(), 1, rdram_size, file) == rdram_size;
+    }
+
+    recording_out.tasks.clear();
+    while (ok) {
+        Task task;
+        task.dmem.resize(dmem_size);
+        size_t dmem_read = fread(task.dmem.data(), 1, dmem_size, file);
+        if (dmem_read == 0 && feof(file)) {
+            break;
+        }
+        // A task cut off by the game exiting mid-capture is dropped rather than treated as an error.
+        if (dmem_read != dmem_size || !read_ranges(file, task.inputs) || !read_ranges(file, task.outputs)) {
+            break;
+        }
+        recording_out.tasks.emplace_back(std::move(task));
+    }
+
+    fclose(file);
+    return ok;
+}
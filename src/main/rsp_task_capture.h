@@ -0,0 +1,71 @@
+#ifndef __RSP_TASK_CAPTURE_H__
+#define __RSP_TASK_CAPTURE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "librecomp/rsp.hpp"
+
+// Recording of RSP tasks for replaying them outside of the game, e.g. to benchmark the recompiled audio microcode.
+//
+// File layout, all values in host byte order:
+//   magic (8 bytes), rdram size (u32), RDRAM image at the start of the first task.
+//   For each task: DMEM at the start of the task (dmem_size bytes),
+//                  input ranges (RDRAM changes made since the previous task ended),
+//                  output ranges (RDRAM changes made while the task ran).
+//   Each range list is a u32 count followed by (u32 offset, u32 size, bytes) entries.
+namespace zelda64 {
+    namespace rsp_capture {
+        constexpr char file_magic[8] = { 'R', 'S', 'P', 'C', 'A', 'P', '0', '2' };
+        // Covers the patches' extra RAM above the game's 8MB as well, as the music driver's sample data is served from there.
+        constexpr uint32_t rdram_size = 16 * 1024 * 1024;
+        constexpr uint32_t dmem_size = 0x1000;
+
+        struct Range {
+            uint32_t offset;
+            std::vector<uint8_t> bytes;
+        };
+
+        struct Task {
+            std::vector<uint8_t> dmem;
+            std::vector<Range> inputs;
+            std::vector<Range> outputs;
+        };
+
+        struct Recording {
+            std::vector<uint8_t> initial_rdram;
+            std::vector<Task> tasks;
+        };
+
+        bool start(const std::filesystem::path& path);
+        void stop();
+        bool is_active();
+        bool load(const std::filesystem::path& path, Recording& recording_out);
+
+        void begin_task(uint8_t* rdram);
+        void end_task(uint8_t* rdram);
+
+        // Wraps a microcode function so that every task it runs gets recorded. The microcode signature differs between
+        // runtime versions, so the wrapper is generated from RspUcodeFunc and forwards any extra arguments unchanged.
+        template <typename Sig>
+        struct Recorder;
+
+        template <typename... Args>
+        struct Recorder<RspExitReason(uint8_t*, Args...)> {
+            template <RspUcodeFunc* Func>
+            static RspExitReason run(uint8_t* rdram, Args... args) {
+                begin_task(rdram);
+                RspExitReason ret = Func(rdram, args...);
+                end_task(rdram);
+                return ret;
+            }
+        };
+
+        template <RspUcodeFunc* Func>
+        constexpr RspUcodeFunc* recording_ucode = &Recorder<RspUcodeFunc>::template run<Func>;
+    }
+}
+
+#endif
@@ -12,12 +12,15 @@
 #include "ultramodern/config.hpp"
 
 #include "zelda_render.h"
+#include "zelda_input_latency.h"
+#include "dl_capture.h"
 #include "recomp_ui.h"
 #include "concurrentqueue.h"
 
 static RT64::UserConfiguration::Antialiasing device_max_msaa = RT64::UserConfiguration::Antialiasing::None;
 static bool sample_positions_supported = false;
 static bool high_precision_fb_enabled = false;
+static zelda64::renderer::RendererType renderer_type = zelda64::renderer::RendererType::RT64;
 
 static uint8_t DMEM[0x1000];
 static uint8_t IMEM[0x1000];
@@ -319,6 +322,7 @@ zelda64::renderer::RT64Context::RT64Context(uint8_t* rdram, ultramodern::rendere
 zelda64::renderer::RT64Context::~RT64Context() = default;
 
 void zelda64::renderer::RT64Context::send_dl(const OSTask* task) {
+    zelda64::dl_capture::record_frame(app->core.RDRAM, task);
     check_texture_pack_actions();
     app->state->rsp->reset();
     app->interpreter->loadUCodeGBI(task->t.ucode & 0x3FFFFFF, task->t.ucode_data & 0x3FFFFFF, true);
@@ -327,6 +331,7 @@ void zelda64::renderer::RT64Context::send_dl(const OSTask* task) {
 
 void zelda64::renderer::RT64Context::update_screen() {
     app->updateScreen();
+    zelda64::input::record_present();
 }
 
 void zelda64::renderer::RT64Context::shutdown() {
@@ -450,9 +455,32 @@ RT64::UserConfiguration::Antialiasing zelda64::renderer::RT64MaxMSAA() {
 }
 
 std::unique_ptr<ultramodern::renderer::RendererContext> zelda64::renderer::create_render_context(uint8_t* rdram, ultramodern::renderer::WindowHandle window_handle, bool developer_mode) {
+    if (renderer_type == RendererType::Null) {
+        return std::make_unique<zelda64::renderer::NullContext>(rdram);
+    }
     return std::make_unique<zelda64::renderer::RT64Context>(rdram, window_handle, developer_mode);
 }
 
+bool zelda64::renderer::renderer_type_from_string(std::string_view name, RendererType& type_out) {
+    if (name == "rt64") {
+        type_out = RendererType::RT64;
+        return true;
+    }
+    if (name == "null") {
+        type_out = RendererType::Null;
+        return true;
+    }
+    return false;
+}
+
+void zelda64::renderer::set_renderer_type(RendererType type) {
+    renderer_type = type;
+}
+
+zelda64::renderer::RendererType zelda64::renderer::get_renderer_type() {
+    return renderer_type;
+}
+
 bool zelda64::renderer::RT64SamplePositionsSupported() {
     return sample_positions_supported;
 }
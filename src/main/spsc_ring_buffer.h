@@ -0,0 +1,78 @@
+#ifndef __SPSC_RING_BUFFER_H__
+#define __SPSC_RING_BUFFER_H__
+
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace zelda64 {
+    // Wait-free ring buffer for a single producer thread and a single consumer thread.
+    // The read and write positions increase monotonically and are only wrapped when indexing, which lets
+    // either side compute the number of buffered elements from two atomic loads.
+    template <typename T>
+    class SpscRingBuffer {
+        static_assert(std::is_trivially_copyable_v<T>, "SpscRingBuffer only supports trivially copyable types");
+    public:
+        // The capacity is rounded up to the next power of two.
+        explicit SpscRingBuffer(size_t min_capacity) :
+            capacity{std::bit_ceil(std::max(min_capacity, size_t{2}))}, mask{capacity - 1}, data{std::make_unique<T[]>(capacity)} {}
+
+        SpscRingBuffer(const SpscRingBuffer&) = delete;
+        SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+        size_t get_capacity() const { return capacity; }
+
+        // Number of elements currently buffered. Can be called from any thread, but the value may be stale by the time it's used.
+        // The read position is loaded first: it never passes the write position, so a later load of the write position
+        // can't be behind it. The write position can move ahead in between though, so the result is capped to the capacity.
+        size_t size() const {
+            size_t cur_read = read_pos.load(std::memory_order_acquire);
+            size_t cur_write = write_pos.load(std::memory_order_acquire);
+            return std::min(cur_write - cur_read, capacity);
+        }
+
+        // Producer only. Writes as many of the given elements as fit and returns the number written.
+        size_t write(const T* values, size_t count) {
+            size_t cur_write = write_pos.load(std::memory_order_relaxed);
+            size_t cur_read = read_pos.load(std::memory_order_acquire);
+            count = std::min(count, capacity - (cur_write - cur_read));
+
+            size_t start = cur_write & mask;
+            size_t first_part = std::min(count, capacity - start);
+            std::memcpy(&data[start], values, first_part * sizeof(T));
+            std::memcpy(&data[0], values + first_part, (count - first_part) * sizeof(T));
+
+            write_pos.store(cur_write + count, std::memory_order_release);
+            return count;
+        }
+
+        // Consumer only. Reads up to `count` elements and returns the number read.
+        size_t read(T* values, size_t count) {
+            size_t cur_read = read_pos.load(std::memory_order_relaxed);
+            size_t cur_write = write_pos.load(std::memory_order_acquire);
+            count = std::min(count, cur_write - cur_read);
+
+            size_t start = cur_read & mask;
+            size_t first_part = std::min(count, capacity - start);
+            std::memcpy(values, &data[start], first_part * sizeof(T));
+            std::memcpy(values + first_part, &data[0], (count - first_part) * sizeof(T));
+
+            read_pos.store(cur_read + count, std::memory_order_release);
+            return count;
+        }
+
+    private:
+        const size_t capacity;
+        const size_t mask;
+        std::unique_ptr<T[]> data;
+        // Kept on separate cache lines to avoid false sharing between the producer and consumer.
+        alignas(64) std::atomic<size_t> write_pos{0};
+        alignas(64) std::atomic<size_t> read_pos{0};
+    };
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include "zelda_sound.h"
 #include "zelda_config.h"
 #include "zelda_debug.h"
+#include "zelda_audio_stats.h"
+#include "zelda_input_latency.h"
 #include "zelda_render.h"
 #include "zelda_support.h"
 #include "promptfont.h"
@@ -12,6 +14,8 @@
 
 #include "core/ui_context.h"
 
+#include <algorithm>
+
 ultramodern::renderer::GraphicsConfig new_options;
 Rml::DataModelHandle nav_help_model_handle;
 Rml::DataModelHandle general_model_handle;
@@ -364,10 +368,14 @@ struct SoundOptionsContext {
     std::atomic<int> main_volume; // Option to control the volume of all sound
     std::atomic<int> bgm_volume;
     std::atomic<int> low_health_beeps_enabled; // RmlUi doesn't seem to like "true"/"false" strings for setting variants so an int is used here instead.
+    std::atomic<int> resampler_mode; // Stored as an int for the same reason, read by the audio thread on every queued chunk.
+    std::atomic<int> audio_latency;
     void reset() {
         bgm_volume = 100;
         main_volume = 100;
         low_health_beeps_enabled = (int)true;
+        resampler_mode = (int)zelda64::ResamplerMode::Sinc;
+        audio_latency = 40;
     }
     SoundOptionsContext() {
         reset();
@@ -416,6 +424,28 @@ bool zelda64::get_low_health_beeps_enabled() {
     return (bool)sound_options_context.low_health_beeps_enabled.load();
 }
 
+void zelda64::set_resampler_mode(zelda64::ResamplerMode mode) {
+    sound_options_context.resampler_mode.store((int)mode);
+    if (sound_options_model_handle) {
+        sound_options_model_handle.DirtyVariable("resampler_mode");
+    }
+}
+
+zelda64::ResamplerMode zelda64::get_resampler_mode() {
+    return (zelda64::ResamplerMode)sound_options_context.resampler_mode.load();
+}
+
+void zelda64::set_audio_latency(int latency_ms) {
+    sound_options_context.audio_latency.store(std::clamp(latency_ms, zelda64::min_audio_latency, zelda64::max_audio_latency));
+    if (sound_options_model_handle) {
+        sound_options_model_handle.DirtyVariable("audio_latency");
+    }
+}
+
+int zelda64::get_audio_latency() {
+    return sound_options_context.audio_latency.load();
+}
+
 struct DebugContext {
     Rml::DataModelHandle model_handle;
     std::vector<std::string> area_names;
@@ -427,6 +457,8 @@ struct DebugContext {
     int set_time_day = 1;
     int set_time_hour = 12;
     int set_time_minute = 0;
+    std::vector<std::string> audio_stats_lines;
+    std::vector<std::string> input_latency_lines;
     bool debug_enabled = false;
 
     DebugContext() {
@@ -582,6 +614,48 @@ public:
             [](const std::string& param, Rml::Event& event) {
                 zelda64::set_time(debug_context.set_time_day, debug_context.set_time_hour, debug_context.set_time_minute);
             });
+
+        recompui::register_event(listener, "refresh_audio_stats",
+            [](const std::string& param, Rml::Event& event) {
+                debug_context.audio_stats_lines = zelda64::audio::format_stats(zelda64::audio::get_stats());
+                debug_context.model_handle.DirtyVariable("audio_stats_lines");
+            });
+
+        recompui::register_event(listener, "reset_audio_stats",
+            [](const std::string& param, Rml::Event& event) {
+                zelda64::audio::reset_stats();
+                debug_context.audio_stats_lines = zelda64::audio::format_stats(zelda64::audio::get_stats());
+                debug_context.model_handle.DirtyVariable("audio_stats_lines");
+            });
+
+        recompui::register_event(listener, "dump_audio_stats",
+            [](const std::string& param, Rml::Event& event) {
+                std::filesystem::path stats_path = zelda64::get_app_folder_path() / "audio_stats.txt";
+                if (!zelda64::audio::dump_stats(stats_path)) {
+                    recompui::message_box("Failed to write audio stats file.");
+                }
+            });
+
+        recompui::register_event(listener, "refresh_input_latency",
+            [](const std::string& param, Rml::Event& event) {
+                debug_context.input_latency_lines = zelda64::input::format_latency_stats(zelda64::input::get_latency_stats());
+                debug_context.model_handle.DirtyVariable("input_latency_lines");
+            });
+
+        recompui::register_event(listener, "reset_input_latency",
+            [](const std::string& param, Rml::Event& event) {
+                zelda64::input::reset_latency_stats();
+                debug_context.input_latency_lines = zelda64::input::format_latency_stats(zelda64::input::get_latency_stats());
+                debug_context.model_handle.DirtyVariable("input_latency_lines");
+            });
+
+        recompui::register_event(listener, "dump_input_latency",
+            [](const std::string& param, Rml::Event& event) {
+                std::filesystem::path stats_path = zelda64::get_app_folder_path() / "input_latency.csv";
+                if (!zelda64::input::dump_latency_stats(stats_path)) {
+                    recompui::message_box("Failed to write input latency file.");
+                }
+            });
     }
 
     void bind_config_list_events(Rml::DataModelConstructor &constructor) {
@@ -939,6 +1013,8 @@ public:
         bind_atomic(constructor, sound_options_model_handle, "main_volume", &sound_options_context.main_volume);
         bind_atomic(constructor, sound_options_model_handle, "bgm_volume", &sound_options_context.bgm_volume);
         bind_atomic(constructor, sound_options_model_handle, "low_health_beeps_enabled", &sound_options_context.low_health_beeps_enabled);
+        bind_atomic(constructor, sound_options_model_handle, "resampler_mode", &sound_options_context.resampler_mode);
+        bind_atomic(constructor, sound_options_model_handle, "audio_latency", &sound_options_context.audio_latency);
     }
 
     void make_debug_bindings(Rml::Context* context) {
@@ -969,6 +1045,9 @@ public:
         constructor.Bind("debug_time_hour", &debug_context.set_time_hour);
         constructor.Bind("debug_time_minute", &debug_context.set_time_minute);
 
+        constructor.Bind("audio_stats_lines", &debug_context.audio_stats_lines);
+        constructor.Bind("input_latency_lines", &debug_context.input_latency_lines);
+
         debug_context.model_handle = constructor.GetModelHandle();
     }
 
@@ -665,7 +665,7 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
                 bool* await_stick_return = axis_event->axis == SDL_GameControllerAxis::SDL_CONTROLLER_AXIS_LEFTY
                         ? &ui_state->await_stick_return_y
                         : &ui_state->await_stick_return_x;
-                if (fabsf(axis_value) > 0.5f) {
+                if (fabsf(axis_value) > recompui::stick_navigate_threshold) {
                     if (!*await_stick_return) {
                         *await_stick_return = true;
                         non_mouse_interacted = true;
@@ -679,7 +679,7 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
                     non_mouse_interacted = true;
                     cont_interacted = true;
                 }
-                else if (*await_stick_return && fabsf(axis_value) < 0.15f) {
+                else if (*await_stick_return && fabsf(axis_value) < recompui::stick_return_threshold) {
                     *await_stick_return = false;
                     // Stop pressing the current key if the axis that was released was the one triggering key presses.
                     int sdl_key = cont_axis_to_key(cur_event.caxis, axis_value);